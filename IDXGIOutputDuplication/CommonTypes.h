@@ -11,6 +11,7 @@
 #include <windows.h>
 #include <d3d11.h>
 #include <dxgi1_2.h>
+#include <dxgi1_5.h>
 #include <sal.h>
 #include <new>
 //#include <warning.h>
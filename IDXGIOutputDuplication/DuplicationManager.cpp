@@ -6,13 +6,14 @@
 // Copyright (c) Microsoft Corporation. All rights reserved
 
 #include "DuplicationManager.h"
+#include <stdio.h>
 #include <wchar.h>
 #include <comdef.h>
 
 // Below are lists of errors expect from Dxgi API calls when a transition event like mode change, PnpStop, PnpStart
 // desktop switch, TDR or session disconnect/reconnect. In all these cases we want the application to clean up the threads that process
 // the desktop updates and attempt to recreate them.
-// If we get an error that is not on the appropriate list then we exit the application
+// Errors that are not on the appropriate list are logged, kuemmel retries those with a backoff
 
 // These are the errors we expect from general Dxgi API due to a transition
 HRESULT SystemTransitionsExpectedErrors[] = {
@@ -45,30 +46,17 @@ HRESULT EnumOutputsExpectedErrors[] = {
                                       };
 
 //
-// Displays a message
+// Logs a message, capture threads must not block on a dialog
 //
 void DisplayMsg(_In_ LPCWSTR Str, _In_ LPCWSTR Title, HRESULT hr)
 {
     if (SUCCEEDED(hr))
     {
-        MessageBoxW(nullptr, Str, Title, MB_OK);
+        fwprintf(stderr, L"%s: %s\n", Title, Str);
         return;
     }
 
-    const UINT StringLen = (UINT)(wcslen(Str) + sizeof(" with HRESULT 0x########."));
-    wchar_t* OutStr = new wchar_t[StringLen];
-    if (!OutStr)
-    {
-        return;
-    }
-
-    INT LenWritten = swprintf_s(OutStr, StringLen, L"%s with 0x%X.", Str, hr);
-    if (LenWritten != -1)
-    {
-        MessageBoxW(nullptr, OutStr, Title, MB_OK);
-    }
-
-    delete [] OutStr;
+    fwprintf(stderr, L"%s: %s with 0x%X.\n", Title, Str, hr);
 }
 
 _Post_satisfies_(return != DUPL_RETURN_SUCCESS)
@@ -126,7 +114,7 @@ DUPL_RETURN ProcessFailure(_In_opt_ ID3D11Device* Device, _In_ LPCWSTR Str, _In_
         }
     }
 
-    // Error was not expected so display the message box
+    // Error was not expected so log it
     DisplayMsg(Str, Title, TranslatedHr);
 
     return DUPL_RETURN_ERROR_UNEXPECTED;
@@ -176,9 +164,9 @@ DUPLICATIONMANAGER::~DUPLICATIONMANAGER()
 }
 
 //
-// Initialize duplication interfaces
+// Initialize duplication interfaces, with AllowFp16 HDR desktops are duplicated as R16G16B16A16_FLOAT
 //
-DUPL_RETURN DUPLICATIONMANAGER::InitDupl(_In_ ID3D11Device* Device, UINT Output)
+DUPL_RETURN DUPLICATIONMANAGER::InitDupl(_In_ ID3D11Device* Device, UINT Output, bool AllowFp16)
 {
     m_OutputNumber = Output;
 
@@ -235,15 +223,35 @@ DUPL_RETURN DUPLICATIONMANAGER::InitDupl(_In_ ID3D11Device* Device, UINT Output)
         return ProcessFailure(nullptr, L"Failed to QI for DxgiOutput1 in DUPLICATIONMANAGER", L"Error", hr);
     }
 
-    // Create desktop duplication
-    hr = DxgiOutput1->DuplicateOutput(m_Device, &m_DeskDupl);
+    // Create desktop duplication, DuplicateOutput1 needs IDXGIOutput5 so fall back to DuplicateOutput
+    hr = E_NOINTERFACE;
+    if (AllowFp16)
+    {
+        IDXGIOutput5* DxgiOutput5 = nullptr;
+        hr = DxgiOutput1->QueryInterface(__uuidof(IDXGIOutput5), reinterpret_cast<void**>(&DxgiOutput5));
+        if (SUCCEEDED(hr))
+        {
+            DXGI_FORMAT Formats[] = { DXGI_FORMAT_R16G16B16A16_FLOAT, DXGI_FORMAT_B8G8R8A8_UNORM };
+            hr = DxgiOutput5->DuplicateOutput1(m_Device, 0, ARRAYSIZE(Formats), Formats, &m_DeskDupl);
+            DxgiOutput5->Release();
+            DxgiOutput5 = nullptr;
+        }
+        if (FAILED(hr))
+        {
+            wprintf(L"FP16 duplication not available (0x%X), using 8 bit\n", hr);
+        }
+    }
+    if (FAILED(hr))
+    {
+        hr = DxgiOutput1->DuplicateOutput(m_Device, &m_DeskDupl);
+    }
     DxgiOutput1->Release();
     DxgiOutput1 = nullptr;
     if (FAILED(hr))
     {
         if (hr == DXGI_ERROR_NOT_CURRENTLY_AVAILABLE)
         {
-            MessageBoxW(nullptr, L"There is already the maximum number of applications using the Desktop Duplication API running, please close one of those applications and then try again.", L"Error", MB_OK);
+            DisplayMsg(L"There is already the maximum number of applications using the Desktop Duplication API running, please close one of those applications and then try again.", L"Error", S_OK);
             return DUPL_RETURN_ERROR_UNEXPECTED;
         }
         return ProcessFailure(m_Device, L"Failed to get duplicate output in DUPLICATIONMANAGER", L"Error", hr, CreateDuplicationExpectedErrors);
@@ -333,13 +341,13 @@ DUPL_RETURN DUPLICATIONMANAGER::GetMouse(_Inout_ PTR_INFO* PtrInfo, _In_ DXGI_OU
 // Get next frame and write it into Data
 //
 _Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS)
-DUPL_RETURN DUPLICATIONMANAGER::GetFrame(_Out_ FRAME_DATA* Data, _Out_ bool* Timeout)
+DUPL_RETURN DUPLICATIONMANAGER::GetFrame(_Out_ FRAME_DATA* Data, _Out_ bool* Timeout, UINT TimeoutInMilliseconds)
 {
     IDXGIResource* DesktopResource = nullptr;
     DXGI_OUTDUPL_FRAME_INFO FrameInfo;
 
     // Get new frame
-    HRESULT hr = m_DeskDupl->AcquireNextFrame(500, &FrameInfo, &DesktopResource);
+    HRESULT hr = m_DeskDupl->AcquireNextFrame(TimeoutInMilliseconds, &FrameInfo, &DesktopResource);
     if (hr == DXGI_ERROR_WAIT_TIMEOUT)
     {
         *Timeout = true;
@@ -368,6 +376,10 @@ DUPL_RETURN DUPLICATIONMANAGER::GetFrame(_Out_ FRAME_DATA* Data, _Out_ bool* Tim
         return ProcessFailure(nullptr, L"Failed to QI for ID3D11Texture2D from acquired IDXGIResource in DUPLICATIONMANAGER", L"Error", hr);
     }
 
+    // Pointer only updates come without metadata
+    Data->MoveCount = 0;
+    Data->DirtyCount = 0;
+
     // Get metadata
     if (FrameInfo.TotalMetadataBufferSize)
     {
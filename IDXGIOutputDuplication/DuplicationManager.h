@@ -18,9 +18,9 @@ class DUPLICATIONMANAGER
     public:
         DUPLICATIONMANAGER();
         ~DUPLICATIONMANAGER();
-        _Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS) DUPL_RETURN GetFrame(_Out_ FRAME_DATA* Data, _Out_ bool* Timeout);
+        _Success_(*Timeout == false && return == DUPL_RETURN_SUCCESS) DUPL_RETURN GetFrame(_Out_ FRAME_DATA* Data, _Out_ bool* Timeout, UINT TimeoutInMilliseconds = 500);
         DUPL_RETURN DoneWithFrame();
-        DUPL_RETURN InitDupl(_In_ ID3D11Device* Device, UINT Output);
+        DUPL_RETURN InitDupl(_In_ ID3D11Device* Device, UINT Output, bool AllowFp16 = false);
         DUPL_RETURN GetMouse(_Inout_ PTR_INFO* PtrInfo, _In_ DXGI_OUTDUPL_FRAME_INFO* FrameInfo, INT OffsetX, INT OffsetY);
         void GetOutputDesc(_Out_ DXGI_OUTPUT_DESC* DescPtr);
 
@@ -0,0 +1,21 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Everything handed to spice starts with an asset, the release_info.id of
+ * the command points to it. Spice hands it back through release_asset()
+ * once it is done with the command.
+ */
+struct asset {
+	void (*release)(struct asset *asset);
+};
+
+void release_asset(void *asset);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* monotonic time in us */
+static inline int64_t bench_now(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+
+	return (int64_t) (count.QuadPart * 1000000 / freq.QuadPart);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* CPU time of the process in us, all threads, user and kernel */
+static inline int64_t bench_cpu(void)
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	ULARGE_INTEGER k, u;
+
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+
+	return (int64_t) ((k.QuadPart + u.QuadPart) / 10);
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* small deterministic generator, runs are comparable across platforms */
+static inline uint32_t bench_rand(uint32_t *state)
+{
+	*state = *state * 1664525u + 1013904223u;
+
+	return *state >> 8;
+}
@@ -0,0 +1,167 @@
+#include <math.h>
+#include <string.h>
+
+#ifdef BENCH_SIZES
+#include <stdio.h>
+#include <jpeglib.h>
+#include <zlib.h>
+#endif
+
+#include "bench.h"
+#include "classify.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define ROUNDS 20
+
+/* dark anti-aliased strokes on a white page, a few grey levels */
+static uint32_t text_pixel(int x, int y, uint32_t *state)
+{
+	static const uint32_t levels[] = { 0xffffff, 0xc0c0c0, 0x808080, 0x202020 };
+
+	if (y % 20 >= 14 || (x / 7 + y / 20) % 9 == 0)
+		return 0xffffff;
+	if ((x + y / 3) % 5)
+		return 0xffffff;
+
+	return levels[bench_rand(state) & 3];
+}
+
+/* smooth gradients with sensor noise */
+static uint32_t photo_pixel(int x, int y, uint32_t *state)
+{
+	int v = (int) (128 + 90 * sin(x * 0.013) * cos(y * 0.021)) + (int) (bench_rand(state) % 7);
+
+	return (uint32_t) v << 16 | (uint32_t) (v * 3 / 4) << 8 | (uint32_t) (255 - v);
+}
+
+#ifdef BENCH_SIZES
+/*
+ * Stand-ins for spice's compressors: deflate at its fastest level for the
+ * lossless ones, JPEG at spice's default quality for photo like images.
+ * Every rect is compressed on its own, like a separate drawable.
+ */
+static size_t deflate_size(const uint32_t *pixels, const struct rect *rect)
+{
+	int width = rect_width(rect), height = rect_height(rect), y;
+	uint32_t *copy = malloc((size_t) width * height * 4);
+	uLongf size = compressBound((uLong) width * height * 4);
+	Bytef *out = malloc(size);
+
+	for (y = 0; y < height; ++y)
+		memcpy(copy + (size_t) y * width, pixels + (size_t) (rect->top + y) * WIDTH + rect->left, width * 4);
+	compress2(out, &size, (const Bytef *) copy, (uLong) width * height * 4, 1);
+
+	free(copy);
+	free(out);
+
+	return size;
+}
+
+static size_t jpeg_size(const uint32_t *pixels, const struct rect *rect)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	unsigned char *out = NULL;
+	unsigned long size = 0;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &out, &size);
+	cinfo.image_width = rect_width(rect);
+	cinfo.image_height = rect_height(rect);
+	cinfo.input_components = 4;
+	cinfo.in_color_space = JCS_EXT_BGRX;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 85, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		JSAMPROW row = (JSAMPROW) (pixels + (size_t) (rect->top + cinfo.next_scanline) * WIDTH + rect->left);
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(out);
+
+	return size;
+}
+
+/* the whole frame losslessly against every part with the compressor for its content */
+static void run_sizes(const uint32_t *pixels, const struct content_rect *rects, int n)
+{
+	struct rect frame = { 0, 0, WIDTH, HEIGHT };
+	int64_t start, unsplit_us, split_us;
+	size_t unsplit, split = 0;
+	int i;
+
+	start = bench_now();
+	unsplit = deflate_size(pixels, &frame);
+	unsplit_us = bench_now() - start;
+
+	start = bench_now();
+	for (i = 0; i < n; ++i)
+		split += rects[i].content == CONTENT_IMAGE ? jpeg_size(pixels, &rects[i].rect)
+												   : deflate_size(pixels, &rects[i].rect);
+	split_us = bench_now() - start;
+
+	printf("       lossless %zu KB in %.1f ms, split %zu KB in %.1f ms\n",
+		   unsplit / 1024, unsplit_us / 1000.0, split / 1024, split_us / 1000.0);
+}
+#endif
+
+static void run(const char *name, const uint32_t *pixels)
+{
+	struct content_rect rects[16];
+	int64_t start, elapsed;
+	int64_t image_area = 0;
+	int n = 0, i;
+
+	start = bench_now();
+	for (i = 0; i < ROUNDS; ++i)
+		n = classify_split((const uint8_t *) pixels, WIDTH * 4, WIDTH, HEIGHT, rects, 16);
+	elapsed = bench_now() - start;
+
+	for (i = 0; i < n; ++i)
+		if (rects[i].content == CONTENT_IMAGE)
+			image_area += rect_area(&rects[i].rect);
+
+	printf("%-6s %dx%d: %.2f ms, %.0f Mpixel/s, %d rects, %.0f%% image\n", name, WIDTH, HEIGHT,
+		   elapsed / 1000.0 / ROUNDS, (double) WIDTH * HEIGHT * ROUNDS / elapsed, n,
+		   100.0 * image_area / ((double) WIDTH * HEIGHT));
+#ifdef BENCH_SIZES
+	run_sizes(pixels, rects, n);
+#endif
+}
+
+int main(void)
+{
+	uint32_t *text = malloc((size_t) WIDTH * HEIGHT * 4);
+	uint32_t *photo = malloc((size_t) WIDTH * HEIGHT * 4);
+	uint32_t *mixed = malloc((size_t) WIDTH * HEIGHT * 4);
+	uint32_t state = 1;
+	int x, y;
+
+	if (!text || !photo || !mixed)
+		return EXIT_FAILURE;
+
+	/* the mixed frame is a browser: text with a photo in the middle */
+	for (y = 0; y < HEIGHT; ++y) {
+		for (x = 0; x < WIDTH; ++x) {
+			size_t i = (size_t) y * WIDTH + x;
+
+			text[i] = text_pixel(x, y, &state);
+			photo[i] = photo_pixel(x, y, &state);
+			mixed[i] = x >= 640 && x < 1280 && y >= 256 && y < 768 ? photo[i] : text[i];
+		}
+	}
+
+	run("text", text);
+	run("photo", photo);
+	run("mixed", mixed);
+
+	free(text);
+	free(photo);
+	free(mixed);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+#include <string.h>
+
+#include "bench.h"
+#include "hdr.h"
+
+#define WIDTH 3840
+#define HEIGHT 2160
+#define FRAMES 20
+
+/* random FP16 values between 1/8 and 4, 40% of them above SDR white */
+static uint16_t random_half(uint32_t *state)
+{
+	return (uint16_t) (0x3000 + bench_rand(state) % 0x1400);
+}
+
+int main(void)
+{
+	struct tonemap tonemap;
+	uint16_t *src = malloc((size_t) WIDTH * HEIGHT * 8);
+	uint32_t *dst = malloc((size_t) WIDTH * HEIGHT * 4);
+	uint32_t state = 1;
+	uint32_t checksum = 0;
+	int64_t start, elapsed;
+	size_t i;
+	int frame;
+
+	if (!src || !dst)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < (size_t) WIDTH * HEIGHT * 4; ++i)
+		src[i] = random_half(&state);
+	tonemap_init(&tonemap, HDR_SCRGB_WHITE_NITS);
+
+	start = bench_now();
+	for (frame = 0; frame < FRAMES; ++frame) {
+		tonemap_copy(&tonemap, (const uint8_t *) src, WIDTH * 8, WIDTH, HEIGHT, (uint8_t *) dst, WIDTH * 4);
+		checksum += dst[frame];
+	}
+	elapsed = bench_now() - start;
+
+	printf("tonemap %dx%d: %.2f ms/frame, %.0f Mpixel/s (checksum %08x)\n", WIDTH, HEIGHT,
+		   elapsed / 1000.0 / FRAMES, (double) WIDTH * HEIGHT * FRAMES / elapsed, checksum);
+
+	free(src);
+	free(dst);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+#include <glib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "metrics.h"
+#include "pool.h"
+#include "scale.h"
+
+/*
+ * Scales a full 4K update to 1440p in bands of 64 rows on the worker
+ * pool, as ProcessRects does, against scaling it on the calling thread.
+ * Read back and spice's compression are not part of it, spice compresses
+ * on its own display worker. Besides the wall time per frame it reports
+ * the CPU time of the process and the time spent in jobs, so the cost of
+ * spreading the work shows up next to its speedup.
+ */
+
+#define SRC_WIDTH 3840
+#define SRC_HEIGHT 2160
+#define DST_WIDTH 2560
+#define DST_HEIGHT 1440
+#define BAND_ROWS 64
+#define FRAMES 20
+
+struct band {
+	struct work work;
+	const struct scaler *scaler;
+	struct rect dst;
+	uint8_t *pixels;
+	const struct rect *src;
+	const uint8_t *src_pixels;
+};
+
+static void band_run(struct work *work)
+{
+	struct band *band = (struct band *) work;
+
+	scaler_scale(band->scaler, &band->dst, band->pixels, DST_WIDTH * 4,
+				 band->src, band->src_pixels, SRC_WIDTH * 4);
+}
+
+struct result {
+	double ms;			/* wall time per frame */
+	double cpu_ms;		/* process CPU time per frame */
+	double worker_ms;	/* time in jobs per frame, summed over threads */
+};
+
+static struct result run(struct work_pool *pool, const struct scaler *scaler, const uint8_t *src, uint8_t *dst)
+{
+	struct band bands[(DST_HEIGHT + BAND_ROWS - 1) / BAND_ROWS];
+	struct work_group group;
+	struct rect src_rect = { 0, 0, SRC_WIDTH, SRC_HEIGHT };
+	int count = sizeof(bands) / sizeof(bands[0]);
+	int64_t start = bench_now(), cpu = bench_cpu(), worker = metrics_get(METRIC_WORKER_US);
+	struct result result;
+	int frame, b;
+
+	work_group_init(&group);
+	for (frame = 0; frame < FRAMES; ++frame) {
+		for (b = 0; b < count; ++b) {
+			struct band *band = &bands[b];
+
+			band->work.run = band_run;
+			band->scaler = scaler;
+			band->dst = (struct rect) { 0, b * BAND_ROWS, DST_WIDTH,
+										(b + 1) * BAND_ROWS < DST_HEIGHT ? (b + 1) * BAND_ROWS : DST_HEIGHT };
+			band->pixels = dst + (size_t) band->dst.top * DST_WIDTH * 4;
+			band->src = &src_rect;
+			band->src_pixels = src;
+			if (pool)
+				work_pool_push(pool, &group, &band->work);
+			else
+				band_run(&band->work);
+		}
+		if (pool)
+			work_group_wait(&group);
+	}
+	work_group_clear(&group);
+
+	result.ms = (bench_now() - start) / 1000.0 / FRAMES;
+	result.cpu_ms = (bench_cpu() - cpu) / 1000.0 / FRAMES;
+	result.worker_ms = (metrics_get(METRIC_WORKER_US) - worker) / 1000.0 / FRAMES;
+
+	return result;
+}
+
+int main(void)
+{
+	static const int workers[] = { 1, 2, 4, 8 };
+	uint8_t *src = malloc((size_t) SRC_WIDTH * SRC_HEIGHT * 4);
+	uint8_t *dst = malloc((size_t) DST_WIDTH * DST_HEIGHT * 4);
+	struct scaler scaler;
+	uint32_t state = 1;
+	struct result single;
+	size_t i;
+
+	if (!src || !dst ||
+		scaler_init(&scaler, SRC_WIDTH, SRC_HEIGHT, DST_WIDTH, DST_HEIGHT, SCALE_FILTER_BILINEAR) < 0)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < (size_t) SRC_WIDTH * SRC_HEIGHT * 4; ++i)
+		src[i] = (uint8_t) bench_rand(&state);
+
+	single = run(NULL, &scaler, src, dst);
+	printf("%dx%d to %dx%d bilinear, %d cores\n", SRC_WIDTH, SRC_HEIGHT, DST_WIDTH, DST_HEIGHT,
+		   g_get_num_processors());
+	printf("no pool     %6.1f ms/frame  cpu %6.1f ms\n", single.ms, single.cpu_ms);
+
+	for (i = 0; i < sizeof(workers) / sizeof(workers[0]); ++i) {
+		struct work_pool pool;
+		struct result result;
+
+		if (work_pool_init(&pool, workers[i]) < 0)
+			return EXIT_FAILURE;
+		result = run(&pool, &scaler, src, dst);
+		printf("%d workers   %6.1f ms/frame  cpu %6.1f ms  in jobs %6.1f ms  %4.2fx\n", workers[i],
+			   result.ms, result.cpu_ms, result.worker_ms, single.ms / result.ms);
+		work_pool_cleanup(&pool);
+	}
+
+	scaler_cleanup(&scaler);
+	free(src);
+	free(dst);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,184 @@
+#include <string.h>
+
+#include "bench.h"
+#include "schedule.h"
+
+/*
+ * Simulates spice's display worker compressing queued drawables one at a
+ * time while a video plays next to a window the user types in. Reports
+ * the latency of the small updates from queueing to compressed.
+ */
+
+#define SIM_US (20 * 1000 * 1000)
+#define WORKER_BYTES_PER_US 150		/* compression throughput */
+#define WORKER_OVERHEAD_US 50		/* per drawable */
+#define FRAME_INTERVAL_US 40000		/* 25 fps video */
+#define TYPING_INTERVAL_US 10000
+
+static const struct rect video_area = { 640, 180, 1920, 900 };
+
+struct job {
+	int64_t arrival;
+	int small;
+	int frame;
+	int bytes;
+};
+
+struct config {
+	const char *name;
+	int fifo;
+	int max_drawable_size;	/* bytes, 0 sends frames whole */
+};
+
+static int compare_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int64_t percentile(int64_t *values, int count, int p)
+{
+	qsort(values, count, sizeof(*values), compare_int64);
+
+	return count ? values[(int64_t) (count - 1) * p / 100] : 0;
+}
+
+static struct job *new_job(int64_t now, int small, int frame, const struct rect *r)
+{
+	struct job *job = malloc(sizeof(*job));
+
+	job->arrival = now;
+	job->small = small;
+	job->frame = frame;
+	job->bytes = rect_width(r) * rect_height(r) * 4;
+
+	return job;
+}
+
+/* a video frame as the display thread queues it, in tiles if configured */
+static void push_frame(struct scheduler *scheduler, const struct config *config, int frame, int64_t now, int *parts)
+{
+	int w = rect_width(&video_area), h = rect_height(&video_area);
+	int tile, x, y;
+
+	*parts = 0;
+	if (!config->max_drawable_size || w * h * 4 <= config->max_drawable_size) {
+		scheduler_push(scheduler, &video_area, 0, new_job(now, 0, frame, &video_area), now);
+		*parts = 1;
+		return;
+	}
+
+	/* same tile size as queue_drawable */
+	for (tile = 16; (tile + 16) * (tile + 16) * 4 <= config->max_drawable_size; tile += 16)
+		;
+
+	for (y = 0; y < h; y += tile) {
+		for (x = 0; x < w; x += tile) {
+			struct rect part = {
+				video_area.left + x,
+				video_area.top + y,
+				video_area.left + (x + tile < w ? x + tile : w),
+				video_area.top + (y + tile < h ? y + tile : h)
+			};
+
+			scheduler_push(scheduler, &part, 1, new_job(now, 0, frame, &part), now);
+			(*parts)++;
+		}
+	}
+}
+
+static void simulate(const struct config *config)
+{
+	struct scheduler scheduler;
+	int64_t *small_latency = malloc(sizeof(int64_t) * (SIM_US / TYPING_INTERVAL_US + 1));
+	int64_t *frame_latency = malloc(sizeof(int64_t) * (SIM_US / FRAME_INTERVAL_US + 1));
+	int *frame_parts = calloc(SIM_US / FRAME_INTERVAL_US + 1, sizeof(int));
+	int64_t *frame_start = calloc(SIM_US / FRAME_INTERVAL_US + 1, sizeof(int64_t));
+	int smalls = 0, frames = 0, frames_done = 0;
+	int64_t next_frame = 0, next_typing = 1234, busy_until = 0;
+	struct job *current = NULL;
+	uint32_t state = 1;
+	int caret_x = 100, caret_y = 200;
+
+	scheduler_init(&scheduler);
+	scheduler.fifo = config->fifo;
+
+	for (int64_t now = 0; now < SIM_US; ) {
+		int64_t next;
+
+		if (current && now >= busy_until) {
+			if (current->small) {
+				small_latency[smalls++] = now - current->arrival;
+			} else if (--frame_parts[current->frame] == 0) {
+				frame_latency[frames_done++] = now - frame_start[current->frame];
+			}
+			free(current);
+			current = NULL;
+		}
+
+		if (now >= next_frame) {
+			frame_start[frames] = now;
+			push_frame(&scheduler, config, frames, now, &frame_parts[frames]);
+			frames++;
+			next_frame += FRAME_INTERVAL_US;
+		}
+
+		if (now >= next_typing) {
+			/* a character and the caret, the pointer rests near the text */
+			struct rect r = { caret_x, caret_y, caret_x + 16, caret_y + 24 };
+
+			scheduler_set_focus(&scheduler, caret_x + 40, caret_y + 60);
+			scheduler_push(&scheduler, &r, 0, new_job(now, 1, 0, &r), now);
+			caret_x += 10;
+			if (caret_x > 560) {
+				caret_x = 100;
+				caret_y = caret_y < 800 ? caret_y + 24 : 200;
+			}
+			next_typing = now + TYPING_INTERVAL_US / 2 + bench_rand(&state) % TYPING_INTERVAL_US;
+		}
+
+		if (!current) {
+			current = scheduler_pop(&scheduler, now, NULL);
+			if (current)
+				busy_until = now + WORKER_OVERHEAD_US + current->bytes / WORKER_BYTES_PER_US;
+		}
+
+		next = next_frame < next_typing ? next_frame : next_typing;
+		if (current && busy_until < next)
+			next = busy_until;
+		now = next > now ? next : now + 1;
+	}
+
+	printf("%-22s typing p50 %6.1f ms  p99 %6.1f ms   video frame p50 %6.1f ms  p99 %6.1f ms\n",
+		   config->name,
+		   percentile(small_latency, smalls, 50) / 1000.0, percentile(small_latency, smalls, 99) / 1000.0,
+		   percentile(frame_latency, frames_done, 50) / 1000.0, percentile(frame_latency, frames_done, 99) / 1000.0);
+
+	while ((current = scheduler_pop(&scheduler, SIM_US, NULL)))
+		free(current);
+	scheduler_cleanup(&scheduler);
+	free(small_latency);
+	free(frame_latency);
+	free(frame_parts);
+	free(frame_start);
+}
+
+int main(void)
+{
+	static const struct config configs[] = {
+		{ "fifo, whole frames", 1, 0 },
+		{ "fifo, 256 KB tiles", 1, 256 * 1024 },
+		{ "priority, whole frames", 0, 0 },
+		{ "priority, 256 KB tiles", 0, 256 * 1024 },
+		{ "priority, 64 KB tiles", 0, 64 * 1024 },
+	};
+	size_t i;
+
+	printf("%dx%d video at 25 fps, %d MB/s compression\n",
+		   rect_width(&video_area), rect_height(&video_area), WORKER_BYTES_PER_US);
+	for (i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i)
+		simulate(&configs[i]);
+
+	return EXIT_SUCCESS;
+}
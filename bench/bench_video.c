@@ -0,0 +1,132 @@
+#include <string.h>
+
+#include "bench.h"
+#include "video.h"
+
+/*
+ * Replays the dirty rects of a 60 fps video, which DXGI reports a bit
+ * different every frame, through the send path of the display thread.
+ * Spice starts a stream once enough drawables of the same size arrive in
+ * a row at a steady pace, the benchmark counts the video frames that
+ * would be streamed.
+ */
+
+#define SIM_US (20 * 1000 * 1000)
+#define FRAME_INTERVAL_US 16667
+/* RED_STREAM_FRAMES_START_CONDITION and RED_STREAM_DETECTION_MAX_DELTA */
+#define STREAM_START_FRAMES 20
+#define STREAM_MAX_DELTA_US (200 * 1000)
+
+static const struct rect video_area = { 320, 180, 1600, 900 };
+static const struct rect clock_area = { 1800, 1040, 1900, 1070 };
+
+struct config {
+	const char *name;
+	int fps;		/* sends per second, 0 sends every frame */
+	int track;
+};
+
+/* what a frame of the video looks like to DXGI */
+static void video_damage(struct region *damage, uint32_t *state)
+{
+	struct rect r = {
+		video_area.left + (int) (bench_rand(state) % 48),
+		video_area.top + (int) (bench_rand(state) % 64),
+		video_area.right - (int) (bench_rand(state) % 48),
+		video_area.bottom - (int) (bench_rand(state) % 64),
+	};
+
+	/* a still band in the picture splits the damage */
+	if (bench_rand(state) % 4 == 0) {
+		int split = r.top + 100 + (int) (bench_rand(state) % 400);
+		struct rect lower = { r.left, split + 32, r.right, r.bottom };
+
+		r.bottom = split;
+		region_add(damage, &lower);
+	}
+	region_add(damage, &r);
+}
+
+static void simulate(const struct config *config)
+{
+	struct video_tracker tracker;
+	struct region damage;
+	int64_t interval = config->fps ? 1000000 / config->fps : 0;
+	int64_t next_send = 0, next_clock = 0, last_video = -1;
+	int64_t tracker_us = 0;
+	int last_w = 0, last_h = 0, run = 0;
+	int drawables = 0, video = 0, streamed = 0, sends = 0;
+	uint32_t state = 1;
+
+	video_tracker_init(&tracker);
+	region_init(&damage);
+
+	for (int64_t now = 0; now < SIM_US; now += FRAME_INTERVAL_US) {
+		struct rect rects[VIDEO_MAX_AREAS + REGION_MAX_RECTS];
+		int n = 0;
+
+		video_damage(&damage, &state);
+		if (now >= next_clock) {
+			region_add(&damage, &clock_area);
+			next_clock += 1000000;
+		}
+
+		if (now < next_send)
+			continue;
+
+		if (config->track) {
+			int64_t start = bench_now();
+
+			n = video_tracker_update(&tracker, &damage, now, rects);
+			tracker_us += bench_now() - start;
+		}
+		for (int i = 0; i < damage.count; ++i)
+			rects[n++] = damage.rects[i];
+
+		for (int i = 0; i < n; ++i) {
+			struct rect overlap;
+			int w = rect_width(&rects[i]), h = rect_height(&rects[i]);
+
+			if (!rect_intersect(&overlap, &rects[i], &video_area))
+				continue;
+
+			/* spice's detector, one candidate stream */
+			if (w == last_w && h == last_h && now - last_video <= STREAM_MAX_DELTA_US)
+				run++;
+			else
+				run = 1;
+			if (run > STREAM_START_FRAMES)
+				streamed++;
+			last_w = w;
+			last_h = h;
+			last_video = now;
+			video++;
+		}
+
+		drawables += n;
+		sends++;
+		region_init(&damage);
+		next_send = now + interval;
+	}
+
+	printf("%-22s %6.1f drawables/s  %6.1f video drawables/s  %5.1f%% of them streamed  tracker %5.2f us/send\n",
+		   config->name, drawables * 1000000.0 / SIM_US, video * 1000000.0 / SIM_US,
+		   video ? 100.0 * streamed / video : 0, sends ? (double) tracker_us / sends : 0);
+}
+
+int main(void)
+{
+	static const struct config configs[] = {
+		{ "every frame", 0, 0 },
+		{ "30 fps", 30, 0 },
+		{ "30 fps, tracked", 30, 1 },
+		{ "every frame, tracked", 0, 1 },
+	};
+	size_t i;
+
+	printf("%dx%d video at 60 fps\n", rect_width(&video_area), rect_height(&video_area));
+	for (i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i)
+		simulate(&configs[i]);
+
+	return EXIT_SUCCESS;
+}
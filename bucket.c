@@ -0,0 +1,51 @@
+#include "bucket.h"
+
+void token_bucket_init(struct token_bucket *bucket, int64_t rate, int64_t burst, int64_t now)
+{
+	bucket->rate = rate;
+	bucket->burst = burst;
+	bucket->tokens = burst;
+	bucket->last = now;
+}
+
+static void token_bucket_refill(struct token_bucket *bucket, int64_t now)
+{
+	int64_t elapsed = now - bucket->last;
+
+	if (elapsed <= 0)
+		return;
+
+	/* long enough to fill up the bucket, elapsed * rate could overflow */
+	if (elapsed / 1000000 > (bucket->burst - bucket->tokens) / bucket->rate) {
+		bucket->tokens = bucket->burst;
+		bucket->last = now;
+		return;
+	}
+
+	bucket->tokens += elapsed * bucket->rate / 1000000;
+	if (bucket->tokens > bucket->burst)
+		bucket->tokens = bucket->burst;
+	/* keep the remainder of partial tokens for the next refill */
+	bucket->last = now - (elapsed * bucket->rate % 1000000) / bucket->rate;
+}
+
+int64_t token_bucket_delay(struct token_bucket *bucket, int64_t now)
+{
+	if (!bucket->rate)
+		return 0;
+
+	token_bucket_refill(bucket, now);
+	if (bucket->tokens >= 0)
+		return 0;
+
+	return (-bucket->tokens * 1000000 + bucket->rate - 1) / bucket->rate;
+}
+
+void token_bucket_consume(struct token_bucket *bucket, int64_t bytes, int64_t now)
+{
+	if (!bucket->rate)
+		return;
+
+	token_bucket_refill(bucket, now);
+	bucket->tokens -= bytes;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Token bucket in bytes. Tokens refill at rate per second up to burst. A
+ * send may take the bucket below zero, the next one waits until it is
+ * refilled, so large updates are not starved by a small burst size.
+ * Times are in us and passed in by the caller.
+ */
+struct token_bucket {
+	int64_t rate;		/* bytes per second, 0 is unlimited */
+	int64_t burst;
+	int64_t tokens;
+	int64_t last;
+};
+
+void token_bucket_init(struct token_bucket *bucket, int64_t rate, int64_t burst, int64_t now);
+
+/* us until a send is allowed, 0 if it is allowed now */
+int64_t token_bucket_delay(struct token_bucket *bucket, int64_t now);
+void token_bucket_consume(struct token_bucket *bucket, int64_t bytes, int64_t now);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
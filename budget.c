@@ -0,0 +1,73 @@
+#include <glib.h>
+
+#include "budget.h"
+#include "metrics.h"
+
+void mem_budget_init(struct mem_budget *budget, size_t limit)
+{
+	g_mutex_init(&budget->lock);
+	g_cond_init(&budget->cond);
+	budget->limit = limit;
+	budget->used = 0;
+	budget->released = 0;
+}
+
+void mem_budget_charge(struct mem_budget *budget, size_t size)
+{
+	g_mutex_lock(&budget->lock);
+	budget->used += size;
+	metrics_set(METRIC_INFLIGHT_BYTES, budget->used);
+	g_mutex_unlock(&budget->lock);
+}
+
+void mem_budget_release(struct mem_budget *budget, size_t size)
+{
+	g_mutex_lock(&budget->lock);
+	budget->used -= size;
+	budget->released++;
+	metrics_add(METRIC_RELEASED_BYTES, size);
+	metrics_set(METRIC_INFLIGHT_BYTES, budget->used);
+	if (budget->limit && budget->used < budget->limit)
+		g_cond_broadcast(&budget->cond);
+	g_mutex_unlock(&budget->lock);
+}
+
+int mem_budget_exhausted(struct mem_budget *budget)
+{
+	int exhausted;
+
+	g_mutex_lock(&budget->lock);
+	exhausted = budget->limit && budget->used >= budget->limit;
+	g_mutex_unlock(&budget->lock);
+
+	return exhausted;
+}
+
+int mem_budget_wait(struct mem_budget *budget, gint64 timeout_us)
+{
+	gint64 end = g_get_monotonic_time() + timeout_us;
+	int ok = 1;
+
+	g_mutex_lock(&budget->lock);
+	while (budget->limit && budget->used >= budget->limit) {
+		if (!g_cond_wait_until(&budget->cond, &budget->lock, end)) {
+			ok = !(budget->used >= budget->limit);
+			break;
+		}
+	}
+	g_mutex_unlock(&budget->lock);
+
+	return ok;
+}
+
+unsigned int mem_budget_flush(struct mem_budget *budget)
+{
+	unsigned int released;
+
+	g_mutex_lock(&budget->lock);
+	released = budget->released;
+	budget->released = 0;
+	g_mutex_unlock(&budget->lock);
+
+	return released;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Bytes held by commands spice has not released yet. Capture waits while
+ * the budget is exhausted, slow clients otherwise make the queues grow
+ * without bound.
+ */
+struct mem_budget {
+	GMutex lock;
+	GCond cond;
+	size_t limit;			/* 0 means unlimited */
+	size_t used;
+	unsigned int released;	/* commands released since the last flush */
+};
+
+void mem_budget_init(struct mem_budget *budget, size_t limit);
+
+void mem_budget_charge(struct mem_budget *budget, size_t size);
+void mem_budget_release(struct mem_budget *budget, size_t size);
+
+int mem_budget_exhausted(struct mem_budget *budget);
+/* waits until usage is below the limit, returns 0 on timeout */
+int mem_budget_wait(struct mem_budget *budget, gint64 timeout_us);
+/* returns and resets the number of commands released since the last call */
+unsigned int mem_budget_flush(struct mem_budget *budget);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "classify.h"
+
+/* a tile with at most this many distinct colors is text like */
+#define TEXT_MAX_COLORS 24
+#define COLOR_TABLE_SIZE 64
+
+/* a neighbour difference above this (sum over r, g and b) is an edge */
+#define EDGE_THRESHOLD 96
+
+static int color_insert(uint32_t *table, uint32_t color)
+{
+	unsigned int i = ((color * 2654435761u) >> 26) & (COLOR_TABLE_SIZE - 1);
+
+	/* 0 marks an empty slot, so black is stored as 0xff000000 */
+	color |= 0xff000000u;
+	while (table[i]) {
+		if (table[i] == color)
+			return 0;
+		i = (i + 1) & (COLOR_TABLE_SIZE - 1);
+	}
+
+	table[i] = color;
+	return 1;
+}
+
+static inline int pixel_diff(uint32_t a, uint32_t b)
+{
+	int d = 0, c;
+
+	for (c = 0; c < 24; c += 8)
+		d += abs((int) ((a >> c) & 0xff) - (int) ((b >> c) & 0xff));
+
+	return d;
+}
+
+enum content_class classify_tile(const uint8_t *pixels, int stride, int width, int height)
+{
+	uint32_t table[COLOR_TABLE_SIZE];
+	int colors = 0;
+	int gradual = 0, sharp = 0, pairs = 0;
+	int x, y;
+
+	memset(table, 0, sizeof(table));
+
+	/* every other line is enough to tell text from photos */
+	for (y = 0; y < height; y += 2) {
+		const uint32_t *row = (const uint32_t *) (pixels + y * stride);
+
+		for (x = 0; x < width; ++x) {
+			if (colors <= TEXT_MAX_COLORS)
+				colors += color_insert(table, row[x]);
+
+			if (x) {
+				int d = pixel_diff(row[x - 1], row[x]);
+
+				if (d > EDGE_THRESHOLD)
+					sharp++;
+				else if (d)
+					gradual++;
+				pairs++;
+			}
+		}
+	}
+
+	if (colors <= TEXT_MAX_COLORS)
+		return CONTENT_TEXT;
+
+	/*
+	 * Photos change a little almost everywhere, anti-aliased text on a
+	 * flat background has mostly equal neighbours and a few hard edges.
+	 */
+	if (gradual * 4 > pairs && gradual > sharp)
+		return CONTENT_IMAGE;
+
+	return CONTENT_TEXT;
+}
+
+static int add_rect(struct content_rect *rects, int n, int max_rects, const struct rect *r,
+					enum content_class content)
+{
+	int i;
+
+	/* grow the rectangle of the tile row above if it has the same extent */
+	for (i = 0; i < n; ++i) {
+		if (rects[i].content == content &&
+			rects[i].rect.left == r->left && rects[i].rect.right == r->right &&
+			rects[i].rect.bottom == r->top) {
+			rects[i].rect.bottom = r->bottom;
+			return n;
+		}
+	}
+
+	if (n == max_rects)
+		return -1;
+
+	rects[n].rect = *r;
+	rects[n].content = content;
+
+	return n + 1;
+}
+
+int classify_split(const uint8_t *pixels, int stride, int width, int height,
+				   struct content_rect *rects, int max_rects)
+{
+	int cols = (width + CLASSIFY_TILE - 1) / CLASSIFY_TILE;
+	int rows = (height + CLASSIFY_TILE - 1) / CLASSIFY_TILE;
+	enum content_class *tiles;
+	int images = 0;
+	int n = 0;
+	int tx, ty;
+
+	if (max_rects < 1)
+		return 0;
+
+	rects[0].rect.left = 0;
+	rects[0].rect.top = 0;
+	rects[0].rect.right = width;
+	rects[0].rect.bottom = height;
+	rects[0].content = CONTENT_TEXT;
+
+	tiles = malloc(cols * rows * sizeof(*tiles));
+	if (!tiles)
+		return 1;
+
+	for (ty = 0; ty < rows; ++ty) {
+		int y = ty * CLASSIFY_TILE;
+		int h = height - y < CLASSIFY_TILE ? height - y : CLASSIFY_TILE;
+
+		for (tx = 0; tx < cols; ++tx) {
+			int x = tx * CLASSIFY_TILE;
+			int w = width - x < CLASSIFY_TILE ? width - x : CLASSIFY_TILE;
+
+			tiles[ty * cols + tx] = classify_tile(pixels + y * stride + x * 4, stride, w, h);
+			images += tiles[ty * cols + tx] == CONTENT_IMAGE;
+		}
+	}
+
+	if (images == 0 || images == cols * rows) {
+		rects[0].content = images ? CONTENT_IMAGE : CONTENT_TEXT;
+		free(tiles);
+		return 1;
+	}
+
+	/* merge runs of equal tiles in a row, then equal runs across rows */
+	for (ty = 0; ty < rows && n >= 0; ++ty) {
+		for (tx = 0; tx < cols && n >= 0; ) {
+			enum content_class content = tiles[ty * cols + tx];
+			int end = tx;
+			struct rect r;
+
+			while (end < cols && tiles[ty * cols + end] == content)
+				end++;
+
+			r.left = tx * CLASSIFY_TILE;
+			r.top = ty * CLASSIFY_TILE;
+			r.right = end * CLASSIFY_TILE < width ? end * CLASSIFY_TILE : width;
+			r.bottom = (ty + 1) * CLASSIFY_TILE < height ? (ty + 1) * CLASSIFY_TILE : height;
+
+			n = add_rect(rects, n, max_rects, &r, content);
+			tx = end;
+		}
+	}
+
+	free(tiles);
+
+	if (n < 0) {
+		rects[0].rect.left = 0;
+		rects[0].rect.top = 0;
+		rects[0].rect.right = width;
+		rects[0].rect.bottom = height;
+		rects[0].content = images * 2 > cols * rows ? CONTENT_IMAGE : CONTENT_TEXT;
+		return 1;
+	}
+
+	return n;
+}
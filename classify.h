@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "rect.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* content is classified in tiles of CLASSIFY_TILE x CLASSIFY_TILE pixels */
+#define CLASSIFY_TILE 64
+
+enum content_class {
+	CONTENT_TEXT,	/* few colors, sharp edges: lossless compressors do well */
+	CONTENT_IMAGE,	/* many colors, gradual changes: photos and video */
+};
+
+struct content_rect {
+	struct rect rect;
+	enum content_class content;
+};
+
+enum content_class classify_tile(const uint8_t *pixels, int stride, int width, int height);
+
+/*
+ * Splits a width x height block of 32 bit pixels into rectangles of
+ * homogeneous content. Rectangles are relative to the block. Returns the
+ * number of rectangles, at most max_rects; a homogeneous block or a block
+ * that would need more than max_rects rectangles is returned as one.
+ */
+int classify_split(const uint8_t *pixels, int stride, int width, int height,
+				   struct content_rect *rects, int max_rects);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
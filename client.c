@@ -0,0 +1,84 @@
+#include <spice/protocol.h>
+#include <string.h>
+
+#include "client.h"
+
+static int has_cap(const uint8_t *caps, int cap)
+{
+	return (caps[cap / 8] >> (cap % 8)) & 1;
+}
+
+void client_caps_parse(struct client_caps *client, int present, const uint8_t *caps)
+{
+	memset(client, 0, sizeof(*client));
+	client->present = present;
+	if (!present)
+		return;
+
+	client->lz4 = has_cap(caps, SPICE_DISPLAY_CAP_LZ4_COMPRESSION);
+	client->monitors_config = has_cap(caps, SPICE_DISPLAY_CAP_MONITORS_CONFIG);
+
+	/* clients predating codec negotiation only know MJPEG */
+	if (!has_cap(caps, SPICE_DISPLAY_CAP_MULTI_CODEC)) {
+		client->codecs = CLIENT_CODEC_MJPEG;
+		return;
+	}
+
+	if (has_cap(caps, SPICE_DISPLAY_CAP_CODEC_MJPEG))
+		client->codecs |= CLIENT_CODEC_MJPEG;
+	if (has_cap(caps, SPICE_DISPLAY_CAP_CODEC_VP8))
+		client->codecs |= CLIENT_CODEC_VP8;
+	if (has_cap(caps, SPICE_DISPLAY_CAP_CODEC_H264))
+		client->codecs |= CLIENT_CODEC_H264;
+	if (has_cap(caps, SPICE_DISPLAY_CAP_CODEC_VP9))
+		client->codecs |= CLIENT_CODEC_VP9;
+	if (has_cap(caps, SPICE_DISPLAY_CAP_CODEC_H265))
+		client->codecs |= CLIENT_CODEC_H265;
+}
+
+int client_can_stream(const struct client_caps *client, unsigned int server_codecs)
+{
+	return !client->present || (client->codecs & server_codecs) != 0;
+}
+
+static const struct {
+	const char *name;
+	unsigned int codec;
+} codec_names[] = {
+	{ "mjpeg", CLIENT_CODEC_MJPEG },
+	{ "vp8", CLIENT_CODEC_VP8 },
+	{ "h264", CLIENT_CODEC_H264 },
+	{ "vp9", CLIENT_CODEC_VP9 },
+	{ "h265", CLIENT_CODEC_H265 },
+};
+
+unsigned int client_codecs_parse(const char *codecs)
+{
+	unsigned int set = 0;
+	const char *p;
+
+	if (!codecs)
+		return CLIENT_CODEC_MJPEG;
+
+	/* entries are encoder:codec separated by semicolons */
+	for (p = codecs; *p; ) {
+		const char *end = strchr(p, ';');
+		const char *colon;
+		size_t len;
+		size_t i;
+
+		if (!end)
+			end = p + strlen(p);
+		colon = memchr(p, ':', end - p);
+		if (colon) {
+			len = end - colon - 1;
+			for (i = 0; i < sizeof(codec_names) / sizeof(codec_names[0]); ++i)
+				if (strlen(codec_names[i].name) == len && !strncmp(colon + 1, codec_names[i].name, len))
+					set |= codec_names[i].codec;
+		}
+
+		p = *end ? end + 1 : end;
+	}
+
+	return set;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* video codecs, as bits of a set */
+enum client_codec {
+	CLIENT_CODEC_MJPEG = 1 << 0,
+	CLIENT_CODEC_VP8 = 1 << 1,
+	CLIENT_CODEC_H264 = 1 << 2,
+	CLIENT_CODEC_VP9 = 1 << 3,
+	CLIENT_CODEC_H265 = 1 << 4,
+};
+
+/* what the display channel client can decode, as reported by spice */
+struct client_caps {
+	int present;
+	int lz4;
+	int monitors_config;
+	unsigned int codecs;
+};
+
+/* caps is the SPICE_DISPLAY_CAP_* bit array of set_client_capabilities */
+void client_caps_parse(struct client_caps *client, int present, const uint8_t *caps);
+
+/*
+ * Whether video areas are worth tracking for the client, it has to decode
+ * one of the server's codecs. Without a client they stay tracked, the
+ * next one usually can and finds the areas settled.
+ */
+int client_can_stream(const struct client_caps *client, unsigned int server_codecs);
+
+/*
+ * Codecs of a spice video codec list such as "gstreamer:h264;spice:mjpeg".
+ * NULL stands for spice's default list, which always has MJPEG.
+ */
+unsigned int client_codecs_parse(const char *codecs);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
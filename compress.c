@@ -0,0 +1,51 @@
+#include <string.h>
+
+#include "compress.h"
+
+#define LOSSY_ENTER_MS 150.0
+#define LOSSLESS_ENTER_MS 30.0
+#define MIN_DWELL_US (5 * 1000000)
+#define SMOOTHING 0.5
+
+void compress_ctl_init(struct compress_ctl *ctl, const struct compress_sample *sample)
+{
+	memset(ctl, 0, sizeof(*ctl));
+	ctl->mode = COMPRESS_LOSSLESS;
+	ctl->last = *sample;
+	ctl->switched = sample->now;
+}
+
+int compress_ctl_update(struct compress_ctl *ctl, const struct compress_sample *sample)
+{
+	int64_t elapsed = sample->now - ctl->last.now;
+	int64_t sent = sample->sent - ctl->last.sent;
+	double latency_ms = 0;
+
+	if (elapsed <= 0)
+		return 0;
+
+	if (sent > 0)
+		latency_ms = (sample->waited - ctl->last.waited) / 1000.0 / sent;
+	/* a stuck queue sends nothing, what still waits counts as well */
+	if (sample->oldest / 1000.0 > latency_ms)
+		latency_ms = sample->oldest / 1000.0;
+
+	ctl->latency_ms = SMOOTHING * latency_ms + (1 - SMOOTHING) * ctl->latency_ms;
+	ctl->drain_rate = sent * 1000000.0 / elapsed;
+	ctl->bandwidth = (sample->released_bytes - ctl->last.released_bytes) * 1000000.0 / elapsed;
+	ctl->last = *sample;
+
+	if (sample->now - ctl->switched < MIN_DWELL_US)
+		return 0;
+
+	if (ctl->mode == COMPRESS_LOSSLESS && ctl->latency_ms > LOSSY_ENTER_MS)
+		ctl->mode = COMPRESS_LOSSY;
+	else if (ctl->mode == COMPRESS_LOSSY && ctl->latency_ms < LOSSLESS_ENTER_MS)
+		ctl->mode = COMPRESS_LOSSLESS;
+	else
+		return 0;
+
+	ctl->switched = sample->now;
+
+	return 1;
+}
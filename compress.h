@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+enum compress_mode {
+	COMPRESS_LOSSLESS,
+	COMPRESS_LOSSY,
+};
+
+/* cumulative counters, the controller works on their differences */
+struct compress_sample {
+	int64_t now;			/* us */
+	int64_t sent;			/* drawables handed to spice */
+	int64_t waited;			/* us these drawables spent queued */
+	int64_t released_bytes;	/* raw bytes of drawables spice is done with */
+	int64_t oldest;			/* us the oldest still queued drawable waited, 0 if none */
+};
+
+/*
+ * Switches to lossy compression while updates back up in the queue and
+ * back to lossless once they drain quickly again. The thresholds are far
+ * apart and every mode is kept for a minimum time, so the mode does not
+ * flap around a threshold.
+ */
+struct compress_ctl {
+	enum compress_mode mode;
+	struct compress_sample last;
+	int64_t switched;		/* us */
+	double latency_ms;		/* average queue latency, smoothed */
+	/* only reported, the queue latency already shows a slow link */
+	double drain_rate;		/* drawables per second */
+	double bandwidth;		/* raw bytes per second spice got rid of */
+};
+
+void compress_ctl_init(struct compress_ctl *ctl, const struct compress_sample *sample);
+
+/* call about once per second, returns 1 if the mode changed */
+int compress_ctl_update(struct compress_ctl *ctl, const struct compress_sample *sample);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,167 @@
+#include <glib.h>
+#include <spice.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cursor.h"
+
+struct cursor_asset {
+	struct asset base;
+	struct cursor_channel *channel;
+	QXLCursorCmd cmd;
+	/* QXLCursor and the shape follow for QXL_CURSOR_SET */
+};
+
+static void cursor_set_release(struct asset *asset)
+{
+	free(asset);
+}
+
+static void cursor_recycle(struct asset *asset)
+{
+	struct cursor_asset *cursor = (struct cursor_asset *) asset;
+	struct cursor_channel *channel = cursor->channel;
+
+	g_mutex_lock(&channel->lock);
+	channel->free_cmds = g_slist_prepend(channel->free_cmds, cursor);
+	g_mutex_unlock(&channel->lock);
+}
+
+QXLCursorCmd *cursor_set_cmd_new(size_t data_size)
+{
+	struct cursor_asset *cursor;
+
+	cursor = calloc(1, sizeof(*cursor) + sizeof(QXLCursor) + data_size);
+	if (!cursor)
+		return NULL;
+
+	cursor->base.release = cursor_set_release;
+
+	cursor->cmd.release_info.id = (uintptr_t) &cursor->base;
+	cursor->cmd.type = QXL_CURSOR_SET;
+	cursor->cmd.u.set.shape = (uintptr_t) (cursor + 1);
+	cursor->cmd.u.set.visible = TRUE;
+
+	return &cursor->cmd;
+}
+
+/* called with the lock held */
+static QXLCursorCmd *cursor_cmd_get(struct cursor_channel *channel)
+{
+	struct cursor_asset *cursor;
+
+	if (channel->free_cmds) {
+		cursor = channel->free_cmds->data;
+		channel->free_cmds = g_slist_delete_link(channel->free_cmds, channel->free_cmds);
+		memset(&cursor->cmd, 0, sizeof(cursor->cmd));
+	} else {
+		cursor = calloc(1, sizeof(*cursor));
+		if (!cursor)
+			return NULL;
+		cursor->base.release = cursor_recycle;
+		cursor->channel = channel;
+	}
+
+	cursor->cmd.release_info.id = (uintptr_t) &cursor->base;
+
+	return &cursor->cmd;
+}
+
+static void cursor_cmd_free(QXLCursorCmd *cmd)
+{
+	struct asset *asset = (struct asset *) (uintptr_t) cmd->release_info.id;
+
+	asset->release(asset);
+}
+
+void cursor_channel_init(struct cursor_channel *channel)
+{
+	memset(channel, 0, sizeof(*channel));
+	g_mutex_init(&channel->lock);
+	channel->visible = TRUE;
+}
+
+void cursor_channel_move(struct cursor_channel *channel, int x, int y, int visible)
+{
+	g_mutex_lock(&channel->lock);
+	if (channel->x != x || channel->y != y || channel->visible != visible) {
+		channel->x = x;
+		channel->y = y;
+		channel->visible = visible;
+		channel->moved = TRUE;
+	}
+	g_mutex_unlock(&channel->lock);
+}
+
+int cursor_channel_has_shape(struct cursor_channel *channel, uint64_t hash)
+{
+	int ret;
+
+	g_mutex_lock(&channel->lock);
+	ret = channel->shape == hash;
+	g_mutex_unlock(&channel->lock);
+
+	return ret;
+}
+
+void cursor_channel_set(struct cursor_channel *channel, QXLCursorCmd *cmd, uint64_t hash)
+{
+	QXLCursor *cursor = (QXLCursor *) (uintptr_t) cmd->u.set.shape;
+	QXLCursorCmd *old;
+
+	/* 0 tells spice not to cache the shape */
+	cursor->header.unique = hash ? hash : 1;
+
+	g_mutex_lock(&channel->lock);
+	old = channel->set;
+	channel->set = cmd;
+	channel->shape = hash;
+	g_mutex_unlock(&channel->lock);
+
+	/* never handed to spice */
+	if (old)
+		cursor_cmd_free(old);
+}
+
+QXLCursorCmd *cursor_channel_pop(struct cursor_channel *channel)
+{
+	QXLCursorCmd *cmd = NULL;
+
+	g_mutex_lock(&channel->lock);
+	if (channel->set) {
+		/* the shape change carries the latest position */
+		cmd = channel->set;
+		channel->set = NULL;
+		cmd->u.set.position.x = channel->x;
+		cmd->u.set.position.y = channel->y;
+		cmd->u.set.visible = channel->visible;
+		channel->moved = FALSE;
+	} else if (channel->moved) {
+		/* a move also shows a hidden cursor */
+		cmd = cursor_cmd_get(channel);
+		if (cmd) {
+			if (channel->visible) {
+				cmd->type = QXL_CURSOR_MOVE;
+				cmd->u.position.x = channel->x;
+				cmd->u.position.y = channel->y;
+			} else {
+				cmd->type = QXL_CURSOR_HIDE;
+			}
+			channel->moved = FALSE;
+		}
+	}
+	g_mutex_unlock(&channel->lock);
+
+	return cmd;
+}
+
+int cursor_channel_pending(struct cursor_channel *channel)
+{
+	int ret;
+
+	g_mutex_lock(&channel->lock);
+	ret = channel->set || channel->moved;
+	g_mutex_unlock(&channel->lock);
+
+	return ret;
+}
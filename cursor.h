@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glib.h>
+#include <spice.h>
+
+#include "asset.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Pointer updates bypass the draw queue. Moves are coalesced to the latest
+ * position, a shape change replaces a pending one and move commands are
+ * recycled once spice releases them.
+ */
+struct cursor_channel {
+	GMutex lock;
+	QXLCursorCmd *set;	/* pending shape change */
+	uint64_t shape;		/* hash of the last queued shape */
+	int x;
+	int y;
+	int visible;
+	int moved;			/* position or visibility changed since last pop */
+	GSList *free_cmds;	/* released move and hide commands */
+};
+
+void cursor_channel_init(struct cursor_channel *channel);
+
+void cursor_channel_move(struct cursor_channel *channel, int x, int y, int visible);
+int cursor_channel_has_shape(struct cursor_channel *channel, uint64_t hash);
+/* takes ownership of cmd, the hash becomes the spice cache id of the shape */
+void cursor_channel_set(struct cursor_channel *channel, QXLCursorCmd *cmd, uint64_t hash);
+
+QXLCursorCmd *cursor_channel_pop(struct cursor_channel *channel);
+int cursor_channel_pending(struct cursor_channel *channel);
+
+/* QXL_CURSOR_SET command with room for data_size bytes of shape data */
+QXLCursorCmd *cursor_set_cmd_new(size_t data_size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
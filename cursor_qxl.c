@@ -0,0 +1,37 @@
+#include <string.h>
+
+#include "cursor_qxl.h"
+
+size_t cursor_qxl_size(const struct cursor_shape *shape)
+{
+	return sizeof(QXLCursor) + shape->size;
+}
+
+void cursor_qxl_fill(QXLCursor *cursor, const struct cursor_shape *shape)
+{
+	switch (shape->format) {
+	case CURSOR_FORMAT_MONO:
+		cursor->header.type = SPICE_CURSOR_TYPE_MONO;
+		break;
+	case CURSOR_FORMAT_COLOR32:
+		cursor->header.type = SPICE_CURSOR_TYPE_COLOR32;
+		break;
+	default:
+		cursor->header.type = SPICE_CURSOR_TYPE_ALPHA;
+		break;
+	}
+
+	cursor->header.width = shape->width;
+	cursor->header.height = shape->height;
+
+	cursor->header.hot_spot_x = shape->hot_x;
+	cursor->header.hot_spot_y = shape->hot_y;
+
+	cursor->data_size = shape->size;
+
+	cursor->chunk.next_chunk = 0;
+	cursor->chunk.prev_chunk = 0;
+	cursor->chunk.data_size = shape->size;
+
+	memcpy(cursor->chunk.data, shape->data, shape->size);
+}
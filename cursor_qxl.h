@@ -0,0 +1,20 @@
+#pragma once
+
+#include <spice/qxl_dev.h>
+
+#include "cursor_shape.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* bytes of the QXLCursor for shape, including its single data chunk */
+size_t cursor_qxl_size(const struct cursor_shape *shape);
+
+/* fills cursor, which has room for cursor_qxl_size bytes, from shape */
+void cursor_qxl_fill(QXLCursor *cursor, const struct cursor_shape *shape);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "cursor_shape.h"
+#include "hash.h"
+
+uint64_t cursor_shape_hash(const struct cursor_shape_info *info, const uint8_t *buffer, size_t size)
+{
+	return hash64(buffer, size, hash64(info, sizeof(*info), 0));
+}
+
+/*
+ * Monochrome: AND 1 and XOR 0 is transparent, AND 0 takes the XOR bit as
+ * black or white. Returns non-zero if a pixel inverts the screen (both bits
+ * set), alpha cursors cannot express that.
+ */
+static int expand_mono_row(uint32_t *dst, const uint8_t *and_row, const uint8_t *xor_row, int width)
+{
+	int invert = 0;
+	int i = 0;
+#ifdef __SSE2__
+	/* lane 0 is the leftmost pixel, the most significant bit */
+	const __m128i hi = _mm_set_epi32(0x10, 0x20, 0x40, 0x80);
+	const __m128i lo = _mm_set_epi32(0x01, 0x02, 0x04, 0x08);
+	const __m128i opaque = _mm_set1_epi32((int) 0xff000000);
+
+	for (; i + 8 <= width; i += 8) {
+		__m128i a = _mm_set1_epi32(and_row[i / 8]);
+		__m128i x = _mm_set1_epi32(xor_row[i / 8]);
+		__m128i a0 = _mm_cmpeq_epi32(_mm_and_si128(a, hi), hi);
+		__m128i x0 = _mm_cmpeq_epi32(_mm_and_si128(x, hi), hi);
+		__m128i a1 = _mm_cmpeq_epi32(_mm_and_si128(a, lo), lo);
+		__m128i x1 = _mm_cmpeq_epi32(_mm_and_si128(x, lo), lo);
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_andnot_si128(a0, _mm_or_si128(x0, opaque)));
+		_mm_storeu_si128((__m128i *) (dst + i + 4), _mm_andnot_si128(a1, _mm_or_si128(x1, opaque)));
+		invert |= and_row[i / 8] & xor_row[i / 8];
+	}
+#endif
+	for (; i < width; ++i) {
+		int bit = 0x80 >> (i & 7);
+		int a = and_row[i / 8] & bit;
+		int x = xor_row[i / 8] & bit;
+
+		dst[i] = a ? 0 : (x ? 0xffffffff : 0xff000000);
+		invert |= a & x;
+	}
+
+	return invert;
+}
+
+/*
+ * Masked color: alpha 0 replaces the screen with the color, otherwise the
+ * color is XORed onto it, black is transparent. Returns non-zero if a pixel
+ * XORs a visible color.
+ */
+static int expand_masked_row(uint32_t *dst, const uint32_t *src, int width)
+{
+	int invert = 0;
+	int i = 0;
+#ifdef __SSE2__
+	const __m128i alpha = _mm_set1_epi32((int) 0xff000000);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i xored = zero;
+
+	for (; i + 4 <= width; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *) (src + i));
+		__m128i replace = _mm_cmpeq_epi32(_mm_and_si128(px, alpha), zero);
+		__m128i visible = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_andnot_si128(alpha, px), zero),
+										   _mm_set1_epi32(-1));
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_and_si128(replace, _mm_or_si128(px, alpha)));
+		xored = _mm_or_si128(xored, _mm_andnot_si128(replace, visible));
+	}
+	invert = _mm_movemask_epi8(xored);
+#endif
+	for (; i < width; ++i) {
+		uint32_t px = src[i];
+
+		if (px & 0xff000000) {
+			dst[i] = 0;
+			invert |= (px & 0x00ffffff) != 0;
+		} else {
+			dst[i] = px | 0xff000000;
+		}
+	}
+
+	return invert;
+}
+
+static int alloc_shape(struct cursor_shape *shape, enum cursor_format format, int width, int height)
+{
+	size_t mask_stride = (width + 7) / 8;
+
+	switch (format) {
+	case CURSOR_FORMAT_ALPHA:
+		shape->size = (size_t) width * height * 4;
+		break;
+	case CURSOR_FORMAT_MONO:
+		shape->size = mask_stride * height * 2;
+		break;
+	case CURSOR_FORMAT_COLOR32:
+		shape->size = (size_t) width * height * 4 + mask_stride * height;
+		break;
+	}
+
+	shape->format = format;
+	shape->width = width;
+	shape->height = height;
+	shape->data = malloc(shape->size);
+
+	return shape->data ? 0 : -1;
+}
+
+static int convert_mono(const struct cursor_shape_info *info, const uint8_t *buffer,
+						struct cursor_shape *shape)
+{
+	int width = info->width;
+	int height = info->height / 2;
+	const uint8_t *and_mask = buffer;
+	const uint8_t *xor_mask = buffer + (size_t) height * info->pitch;
+	int invert = 0;
+	int j;
+
+	if (alloc_shape(shape, CURSOR_FORMAT_ALPHA, width, height) < 0)
+		return -1;
+
+	for (j = 0; j < height; ++j)
+		invert |= expand_mono_row((uint32_t *) shape->data + (size_t) j * width,
+								  and_mask + (size_t) j * info->pitch,
+								  xor_mask + (size_t) j * info->pitch, width);
+
+	if (invert) {
+		/* keep both masks, only the row stride changes */
+		size_t stride = (width + 7) / 8;
+
+		free(shape->data);
+		if (alloc_shape(shape, CURSOR_FORMAT_MONO, width, height) < 0)
+			return -1;
+
+		for (j = 0; j < height; ++j) {
+			memcpy(shape->data + j * stride, and_mask + (size_t) j * info->pitch, stride);
+			memcpy(shape->data + (height + j) * stride, xor_mask + (size_t) j * info->pitch, stride);
+		}
+	}
+
+	return 0;
+}
+
+static int convert_masked(const struct cursor_shape_info *info, const uint8_t *buffer,
+						  struct cursor_shape *shape)
+{
+	int width = info->width;
+	int height = info->height;
+	int invert = 0;
+	int i, j;
+
+	if (alloc_shape(shape, CURSOR_FORMAT_ALPHA, width, height) < 0)
+		return -1;
+
+	for (j = 0; j < height; ++j)
+		invert |= expand_masked_row((uint32_t *) shape->data + (size_t) j * width,
+									(const uint32_t *) (buffer + (size_t) j * info->pitch), width);
+
+	if (invert) {
+		/* color with the alpha byte as AND mask, the client emulates inversion */
+		size_t stride = (width + 7) / 8;
+		uint8_t *mask;
+
+		free(shape->data);
+		if (alloc_shape(shape, CURSOR_FORMAT_COLOR32, width, height) < 0)
+			return -1;
+
+		mask = shape->data + (size_t) width * height * 4;
+		memset(mask, 0, stride * height);
+		for (j = 0; j < height; ++j) {
+			const uint32_t *src = (const uint32_t *) (buffer + (size_t) j * info->pitch);
+			uint32_t *dst = (uint32_t *) shape->data + (size_t) j * width;
+
+			for (i = 0; i < width; ++i) {
+				dst[i] = src[i] & 0x00ffffff;
+				if (src[i] & 0xff000000)
+					mask[j * stride + i / 8] |= 0x80 >> (i & 7);
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int convert_color(const struct cursor_shape_info *info, const uint8_t *buffer,
+						 struct cursor_shape *shape)
+{
+	int j;
+
+	if (alloc_shape(shape, CURSOR_FORMAT_ALPHA, info->width, info->height) < 0)
+		return -1;
+
+	for (j = 0; j < info->height; ++j)
+		memcpy(shape->data + (size_t) j * info->width * 4, buffer + (size_t) j * info->pitch,
+			   (size_t) info->width * 4);
+
+	return 0;
+}
+
+int cursor_shape_convert(const struct cursor_shape_info *info, const uint8_t *buffer, size_t size,
+						 struct cursor_shape *shape)
+{
+	int ret;
+
+	memset(shape, 0, sizeof(*shape));
+
+	if (info->width <= 0 || info->height <= 0 || (size_t) info->pitch * info->height > size)
+		return -1;
+
+	switch (info->type) {
+	case CURSOR_SHAPE_MONOCHROME:
+		if (info->height < 2 || info->pitch < (info->width + 7) / 8)
+			return -1;
+		ret = convert_mono(info, buffer, shape);
+		break;
+	case CURSOR_SHAPE_COLOR:
+		if (info->pitch < info->width * 4)
+			return -1;
+		ret = convert_color(info, buffer, shape);
+		break;
+	case CURSOR_SHAPE_MASKED_COLOR:
+		if (info->pitch < info->width * 4)
+			return -1;
+		ret = convert_masked(info, buffer, shape);
+		break;
+	default:
+		return -1;
+	}
+
+	if (ret < 0) {
+		cursor_shape_free(shape);
+		return -1;
+	}
+
+	shape->hot_x = info->hot_x;
+	shape->hot_y = info->hot_y;
+
+	return 0;
+}
+
+void cursor_shape_free(struct cursor_shape *shape)
+{
+	free(shape->data);
+	memset(shape, 0, sizeof(*shape));
+}
+
+void cursor_cache_init(struct cursor_cache *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+}
+
+void cursor_cache_cleanup(struct cursor_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < CURSOR_CACHE_SIZE; ++i)
+		cursor_shape_free(&cache->shapes[i]);
+	memset(cache, 0, sizeof(*cache));
+}
+
+const struct cursor_shape *cursor_cache_get(struct cursor_cache *cache, uint64_t hash,
+											const struct cursor_shape_info *info,
+											const uint8_t *buffer, size_t size)
+{
+	int victim = 0;
+	int i;
+
+	for (i = 0; i < CURSOR_CACHE_SIZE; ++i) {
+		if (cache->shapes[i].data && cache->shapes[i].hash == hash) {
+			cache->used[i] = ++cache->clock;
+			return &cache->shapes[i];
+		}
+		if (cache->used[i] < cache->used[victim])
+			victim = i;
+	}
+
+	cursor_shape_free(&cache->shapes[victim]);
+	cache->used[victim] = 0;
+	if (cursor_shape_convert(info, buffer, size, &cache->shapes[victim]) < 0)
+		return NULL;
+
+	cache->shapes[victim].hash = hash;
+	cache->used[victim] = ++cache->clock;
+
+	return &cache->shapes[victim];
+}
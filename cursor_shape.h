@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* DXGI_OUTDUPL_POINTER_SHAPE_TYPE values */
+enum cursor_shape_type {
+	CURSOR_SHAPE_MONOCHROME = 1,
+	CURSOR_SHAPE_COLOR = 2,
+	CURSOR_SHAPE_MASKED_COLOR = 4,
+};
+
+/* spice cursor formats, preferred in this order */
+enum cursor_format {
+	CURSOR_FORMAT_ALPHA,	/* 32 bit BGRA */
+	CURSOR_FORMAT_MONO,		/* 1 bit AND mask followed by 1 bit XOR mask */
+	CURSOR_FORMAT_COLOR32,	/* 32 bit BGRX followed by 1 bit AND mask, XOR semantics */
+};
+
+struct cursor_shape_info {
+	enum cursor_shape_type type;
+	int width;
+	int height;		/* for monochrome shapes twice the cursor height */
+	int pitch;
+	int hot_x;
+	int hot_y;
+};
+
+struct cursor_shape {
+	uint64_t hash;
+	enum cursor_format format;
+	int width;
+	int height;
+	int hot_x;
+	int hot_y;
+	size_t size;
+	uint8_t *data;
+};
+
+uint64_t cursor_shape_hash(const struct cursor_shape_info *info, const uint8_t *buffer, size_t size);
+
+/*
+ * Converts a DXGI pointer shape to the spice format the client renders
+ * best: shapes without inverted pixels become alpha cursors, the others
+ * keep their mask semantics.
+ */
+int cursor_shape_convert(const struct cursor_shape_info *info, const uint8_t *buffer, size_t size,
+						 struct cursor_shape *shape);
+void cursor_shape_free(struct cursor_shape *shape);
+
+#define CURSOR_CACHE_SIZE 16
+
+/* converted shapes by hash, the least recently used one is replaced */
+struct cursor_cache {
+	struct cursor_shape shapes[CURSOR_CACHE_SIZE];
+	uint64_t used[CURSOR_CACHE_SIZE];
+	uint64_t clock;
+};
+
+void cursor_cache_init(struct cursor_cache *cache);
+void cursor_cache_cleanup(struct cursor_cache *cache);
+const struct cursor_shape *cursor_cache_get(struct cursor_cache *cache, uint64_t hash,
+											const struct cursor_shape_info *info,
+											const uint8_t *buffer, size_t size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
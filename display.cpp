@@ -8,13 +8,57 @@
 #include "IDXGIOutputDuplication/VertexShader.h"
 
 #include <cstdio>
+#include <cmath>
 
+#include "classify.h"
+#include "cursor.h"
+#include "cursor_qxl.h"
+#include "cursor_shape.h"
+#include "bucket.h"
 #include "display.h"
+#include "idle.h"
+#include "layout.h"
+#include "refine.h"
+#include "region.h"
+#include "rotate.h"
+#include "video.h"
+
+/* the duplicated output, sizes are in desktop orientation */
+struct output {
+	enum rotation rotation;
+	int width;
+	int height;
+	struct rect surface;	/* its head on the primary surface */
+	struct scaler scaler;	/* output to head */
+};
+
+/* one capture thread per output */
+struct capture {
+	struct display_config *cfg;
+	const struct layout_output *layout;
+	struct pointer *pointer;
+};
 
-struct asset {
-	DX_RESOURCES *rsrc;
-	ID3D11Texture2D *texture;
-	D3D11_MAPPED_SUBRESOURCE *mapInfo;
+/*
+ * DXGI reports the pointer through the output it is on. The capture
+ * threads share its state, GetMouse keeps an output the pointer left from
+ * hiding it on another one.
+ */
+struct pointer {
+	GMutex lock;
+	PTR_INFO info;
+	struct cursor_cache cache;
+};
+
+/* a QXL_DRAW_COPY command and the pixels it references */
+struct draw_asset {
+	struct asset base;
+	struct display_config *cfg;
+	void *pixels;
+	size_t size;		/* charged to the memory budget */
+	int bootstrap;		/* tile of a full frame */
+	QXLDrawable drawable;
+	QXLImage image;
 };
 
 DUPL_RETURN InitializeDx(_Out_ DX_RESOURCES* Data)
@@ -107,82 +151,44 @@ DUPL_RETURN InitializeDx(_Out_ DX_RESOURCES* Data)
 	return DUPL_RETURN_SUCCESS;
 }
 
-static QXLCursorCmd *create_cursor_move_cmd(POINT position)
+static void ReleaseDx(DX_RESOURCES *Data)
 {
-	QXLCursorCmd *cmd;
-
-	cmd = (QXLCursorCmd *)calloc(1, sizeof(*cmd));
-	if (!cmd)
-		return NULL;
-
-	cmd->release_info.id = (uintptr_t)cmd;
-	cmd->type = QXL_CURSOR_MOVE;
-	cmd->u.position.x = position.x;
-	cmd->u.position.y = position.y;
-
-	cmd->release_info.id = (uintptr_t)cmd;
-
-	return cmd;
+	if (Data->SamplerLinear)
+		Data->SamplerLinear->Release();
+	if (Data->PixelShader)
+		Data->PixelShader->Release();
+	if (Data->InputLayout)
+		Data->InputLayout->Release();
+	if (Data->VertexShader)
+		Data->VertexShader->Release();
+	if (Data->Context)
+		Data->Context->Release();
+	if (Data->Device)
+		Data->Device->Release();
+	memset(Data, 0, sizeof(*Data));
 }
 
-static QXLCursorCmd *create_cursor_set_cmd(PTR_INFO *ptr_info)
+static QXLCursorCmd *create_cursor_set_cmd(const struct cursor_shape *shape)
 {
 	QXLCursorCmd *cmd;
 	QXLCursor *cursor;
-	unsigned int height_factor = 1;
 
-	cmd = (QXLCursorCmd*)calloc(1, sizeof(*cmd) + sizeof(*cursor) + ptr_info->BufferSize);
+	cmd = cursor_set_cmd_new(shape->size);
 	if (!cmd)
 		return NULL;
 
-	cursor = (QXLCursor *) (cmd + 1);
-
-	cursor->header.unique = 0;
-	switch(ptr_info->ShapeInfo.Type) {
-	case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME:
-		cursor->header.type = SPICE_CURSOR_TYPE_MONO;
-		/*
-		 * height value is twice as big as expected, probably because pixels are present
-		 * two times: once as AND mask, once as XOR-mask
-		 */
-		height_factor = 2;
-		break;
-	case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR:
-		cursor->header.type = SPICE_CURSOR_TYPE_ALPHA;
-		break;
-	default:
-	case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR:
-		printf("ShapeInfo.Type %d not implemented, try SPICE_CURSOR_TYPE_ALPHA\n", ptr_info->ShapeInfo.Type);
-		cursor->header.type = SPICE_CURSOR_TYPE_ALPHA;
-		break;
-	};
-
-	cursor->header.width = ptr_info->ShapeInfo.Width;
-	cursor->header.height = ptr_info->ShapeInfo.Height / height_factor;
-
-	cursor->header.hot_spot_x = ptr_info->ShapeInfo.HotSpot.x;
-	cursor->header.hot_spot_y = ptr_info->ShapeInfo.HotSpot.y;
-
-	cursor->data_size = ptr_info->BufferSize;
-
-	cursor->chunk.next_chunk = 0;
-	cursor->chunk.prev_chunk = 0;
-	cursor->chunk.data_size = ptr_info->BufferSize;
-
-	memcpy(cursor->chunk.data, ptr_info->PtrShapeBuffer, ptr_info->BufferSize);
-
-	cmd->type = QXL_CURSOR_SET;
-	cmd->u.set.position.x = ptr_info->Position.x;
-	cmd->u.set.position.y = ptr_info->Position.y;
-	cmd->u.set.shape = (uintptr_t) cursor;
-	cmd->u.set.visible = TRUE;
-
-	cmd->release_info.id = (uintptr_t)cmd;
+	cursor = (QXLCursor *) cmd->u.set.shape;
+	cursor_qxl_fill(cursor, shape);
 
 	return cmd;
 }
 
-void ProcessPointer(PTR_INFO *ptr_info, GAsyncQueue *cursor_queue)
+/*
+ * Pointer updates go straight to the cursor channel, before the frame is
+ * read back.
+ */
+static void ProcessPointer(PTR_INFO *ptr_info, DXGI_OUTDUPL_FRAME_INFO *frame_info,
+						   struct cursor_cache *cache, struct display_config *cfg)
 {
 	/*
 	 * A zero value indicates that the position or shape of the mouse was not
@@ -190,35 +196,116 @@ void ProcessPointer(PTR_INFO *ptr_info, GAsyncQueue *cursor_queue)
 	 * IDXGIOutputDuplication::AcquireNextFrame method to acquire the next frame
 	 * of the desktop image.
 	 */
-	if (ptr_info->LastTimeStamp.QuadPart) {
-		QXLCursorCmd *cursor_info = create_cursor_move_cmd(ptr_info->Position);
-		g_async_queue_push(cursor_queue, cursor_info);
-	}
+	if (!frame_info->LastMouseUpdateTime.QuadPart)
+		return;
+
+	int x = ptr_info->Position.x;
+	int y = ptr_info->Position.y;
+
+	/* the cursor is not scaled, only its position */
+	layout_point_to_surface(&cfg->layout, &x, &y);
+	cursor_channel_move(cfg->cursor, x, y, ptr_info->Visible);
+
+	g_mutex_lock(cfg->draw_lock);
+	scheduler_set_focus(cfg->draw_queue, x, y);
+	g_mutex_unlock(cfg->draw_lock);
 
 	/*
 	 * A new pointer shape is indicated by a non-zero value in the
-	 * PointerShapeBufferSize member.
+	 * PointerShapeBufferSize member. The same shape is often reported
+	 * again, it is only sent if it differs from the current one.
 	 */
-	if (ptr_info->BufferSize) {
-		QXLCursorCmd *cursor_info = create_cursor_set_cmd(ptr_info);
-		g_async_queue_push(cursor_queue, cursor_info);
+	UINT shape_size = frame_info->PointerShapeBufferSize;
+	if (shape_size) {
+		struct cursor_shape_info info;
+		const uint8_t *buffer = reinterpret_cast<const uint8_t*>(ptr_info->PtrShapeBuffer);
+
+		info.type = static_cast<enum cursor_shape_type>(ptr_info->ShapeInfo.Type);
+		info.width = ptr_info->ShapeInfo.Width;
+		info.height = ptr_info->ShapeInfo.Height;
+		info.pitch = ptr_info->ShapeInfo.Pitch;
+		info.hot_x = ptr_info->ShapeInfo.HotSpot.x;
+		info.hot_y = ptr_info->ShapeInfo.HotSpot.y;
+
+		uint64_t hash = cursor_shape_hash(&info, buffer, shape_size);
+
+		if (!cursor_channel_has_shape(cfg->cursor, hash)) {
+			/* shapes alternate between a few cursors, convert each only once */
+			const struct cursor_shape *shape = cursor_cache_get(cache, hash, &info, buffer, shape_size);
+			QXLCursorCmd *cmd = shape ? create_cursor_set_cmd(shape) : NULL;
+			if (cmd)
+				cursor_channel_set(cfg->cursor, cmd, hash);
+			else if (!shape)
+				fprintf(stderr, "unsupported pointer shape type %d\n", info.type);
+		}
 	}
+
+	spice_qxl_wakeup(cfg->display_sin);
+}
+
+static void release_drawable(struct asset *asset)
+{
+	struct draw_asset *draw = reinterpret_cast<struct draw_asset*>(asset);
+	struct display_config *cfg = draw->cfg;
+
+	if (draw->bootstrap && g_atomic_int_dec_and_test(&cfg->bootstrap_pending))
+		metrics_set(METRIC_FIRST_FRAME_MS, (g_get_monotonic_time() - cfg->bootstrap_start) / 1000);
+
+	mem_budget_release(cfg->budget, draw->size);
+	free(draw->pixels);
+	free(draw);
+}
+
+void display_set_mm_time(struct display_config *cfg, uint32_t mm_time)
+{
+	g_mutex_lock(&cfg->mm_lock);
+	cfg->mm_time = mm_time;
+	cfg->mm_time_base = g_get_monotonic_time();
+	g_mutex_unlock(&cfg->mm_lock);
+}
+
+/*
+ * Spice's multimedia time in ms, extrapolated from its last update. Video
+ * streams are timed by it, the frames of a stream need steady timestamps.
+ */
+static uint32_t current_mm_time(struct display_config *cfg)
+{
+	gint64 now = g_get_monotonic_time();
+	uint32_t mm_time;
+
+	g_mutex_lock(&cfg->mm_lock);
+	if (cfg->mm_time_base)
+		mm_time = cfg->mm_time + static_cast<uint32_t>((now - cfg->mm_time_base) / 1000);
+	else
+		mm_time = static_cast<uint32_t>(now / 1000);
+	g_mutex_unlock(&cfg->mm_lock);
+
+	return mm_time;
 }
 
-static QXLDrawable *create_drawable(int x, int y, int w, int h, int stride, void *pixels, void *asset)
+/* the drawable takes ownership of pixels */
+static QXLDrawable *create_drawable(struct display_config *cfg, int x, int y, int w, int h, int stride, void *pixels)
 {
+	struct draw_asset *draw;
 	QXLDrawable *drawable;
 	QXLImage *qxl_image;
 	int i;
 
-	drawable = (QXLDrawable *)calloc(1, sizeof(*drawable) + sizeof(*qxl_image));
-	if (!drawable)
+	draw = (struct draw_asset *)calloc(1, sizeof(*draw));
+	if (!draw)
 		return NULL;
-	qxl_image = (QXLImage *) (drawable + 1);
+	drawable = &draw->drawable;
+	qxl_image = &draw->image;
 
-	drawable->release_info.id = (uintptr_t)asset;
+	draw->base.release = release_drawable;
+	draw->cfg = cfg;
+	draw->pixels = pixels;
+	draw->size = h * stride;
+	mem_budget_charge(cfg->budget, draw->size);
+	drawable->release_info.id = (uintptr_t)&draw->base;
 
 	drawable->surface_id = 0;
+	drawable->mm_time = current_mm_time(cfg);
 	drawable->type = QXL_DRAW_COPY;
 	drawable->effect = QXL_EFFECT_OPAQUE;
 	drawable->clip.type = SPICE_CLIP_TYPE_NONE;
@@ -256,134 +343,1070 @@ static QXLDrawable *create_drawable(int x, int y, int w, int h, int stride, void
 	return drawable;
 }
 
-void ProcessFrame(DX_RESOURCES *rsrc, FRAME_DATA *current_data, GAsyncQueue *draw_queue, QXLInstance *display_sin)
+/*
+ * Reads the desktop area src out of the frame. The pixels are returned as
+ * 32 bit BGRX in desktop orientation with a stride of rect_width(src) * BPP.
+ */
+static void *read_area(DX_RESOURCES *rsrc, ID3D11Texture2D *frame, const struct output *output,
+					   const struct tonemap *tonemap, const struct rect *src)
 {
 	HRESULT hr;
-//	printf("Dirty %u, Moved %u\n", current_data->DirtyCount, current_data->MoveCount);
-	DXGI_OUTDUPL_MOVE_RECT *pMoveRect = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(current_data->MetaData);
-	RECT *pDirtyRect = reinterpret_cast<RECT*>(current_data->MetaData + (current_data->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+	struct rect tex;
+
+	rotation_rect_to_texture(output->rotation, output->width, output->height, src, &tex);
 
 	D3D11_TEXTURE2D_DESC desc;
-	current_data->Frame->GetDesc(&desc);
+	frame->GetDesc(&desc);
+
+	D3D11_TEXTURE2D_DESC desc2;
+	desc2.Width = rect_width(&tex);
+	desc2.Height = rect_height(&tex);
+	desc2.MipLevels = desc.MipLevels;
+	desc2.ArraySize = desc.ArraySize;
+	desc2.Format = desc.Format;
+	desc2.SampleDesc = desc.SampleDesc;
+	desc2.Usage = D3D11_USAGE_STAGING;
+	desc2.BindFlags = 0;
+	desc2.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc2.MiscFlags = 0;
+
+	ID3D11Texture2D *stagingTexture;
+	hr = rsrc->Device->CreateTexture2D(&desc2, nullptr, &stagingTexture);
+	if (FAILED(hr)) {
+		printf("Failed to create staging texture\n");
+		return NULL;
+	}
+
+	D3D11_BOX sourceRegion;
+	sourceRegion.left = tex.left;
+	sourceRegion.right = tex.right;
+	sourceRegion.top = tex.top;
+	sourceRegion.bottom = tex.bottom;
+	sourceRegion.front = 0;
+	sourceRegion.back = 1;
+
+	rsrc->Context->CopySubresourceRegion(stagingTexture, 0, 0, 0, 0, frame, 0, &sourceRegion);
+
+	D3D11_MAPPED_SUBRESOURCE mapInfo;
+	hr = rsrc->Context->Map(
+			stagingTexture,
+			0,
+			D3D11_MAP_READ,
+			0,
+			&mapInfo);
+	if (FAILED(hr)) {
+		printf("Failed to map staging texture\n");
+		stagingTexture->Release();
+		return NULL;
+	}
+
+	const uint8_t *pixels = reinterpret_cast<const uint8_t*>(mapInfo.pData);
+	int pitch = mapInfo.RowPitch;
+	void *converted = NULL;
+
+	int stride = rect_width(src) * BPP;
+	void *buf = malloc(rect_height(src) * stride);
+
+	/*
+	 * FP16 frames are tone mapped to 8 bit. Without rotation that is the
+	 * only copy, otherwise the rotation reads the converted pixels.
+	 */
+	if (buf && desc.Format == DXGI_FORMAT_R16G16B16A16_FLOAT) {
+		if (output->rotation == ROTATION_0) {
+			tonemap_copy(tonemap, pixels, pitch, rect_width(&tex), rect_height(&tex),
+						 reinterpret_cast<uint8_t*>(buf), stride);
+			pixels = NULL;
+		} else {
+			pitch = rect_width(&tex) * BPP;
+			converted = malloc(rect_height(&tex) * pitch);
+			if (converted)
+				tonemap_copy(tonemap, pixels, mapInfo.RowPitch, rect_width(&tex), rect_height(&tex),
+							 reinterpret_cast<uint8_t*>(converted), pitch);
+			pixels = reinterpret_cast<const uint8_t*>(converted);
+			if (!pixels) {
+				free(buf);
+				buf = NULL;
+			}
+		}
+	}
+
+	if (buf && pixels)
+		rotation_copy(output->rotation,
+					  pixels, pitch,
+					  rect_width(&tex), rect_height(&tex),
+					  reinterpret_cast<uint8_t*>(buf), stride);
+
+	free(converted);
+
+	rsrc->Context->Unmap(stagingTexture, 0);
+
+	stagingTexture->Release();
+
+	return buf;
+}
+
+static void schedule_drawable(struct display_config *cfg, const struct rect *dst, QXLDrawable *drawable, int bulk)
+{
+	g_mutex_lock(cfg->draw_lock);
+	int ret = scheduler_push(cfg->draw_queue, dst, bulk, drawable, g_get_monotonic_time());
+	g_mutex_unlock(cfg->draw_lock);
+
+	if (ret < 0) {
+		release_asset(reinterpret_cast<void*>(drawable->release_info.id));
+		return;
+	}
+
+	spice_qxl_wakeup(cfg->display_sin);
+}
+
+static void push_drawable(struct display_config *cfg, const struct rect *dst, void *buf, int stride, int bulk)
+{
+	QXLDrawable *drawable = create_drawable(
+		cfg,
+		dst->left,
+		dst->top,
+		rect_width(dst),
+		rect_height(dst),
+		stride,
+		buf);
+	if (!drawable) {
+		free(buf);
+		return;
+	}
+
+	schedule_drawable(cfg, dst, drawable, bulk);
+}
+
+/*
+ * Spice compresses a drawable in one go on its display worker, so large
+ * updates are sent as tiles which smaller updates can overtake. Tiles are
+ * always bulk, bulk also marks smaller drawables that can wait.
+ */
+static void queue_drawable(struct display_config *cfg, const struct rect *dst, void *buf, int stride, int bulk)
+{
+	int w = rect_width(dst);
+	int h = rect_height(dst);
+
+	if (!cfg->max_drawable_size || w * h * BPP <= cfg->max_drawable_size) {
+		push_drawable(cfg, dst, buf, stride, bulk);
+		return;
+	}
+
+	/* square tiles, multiple of 16 to line up with the compressors' blocks */
+	int tile = static_cast<int>(sqrt(static_cast<double>(cfg->max_drawable_size / BPP))) & ~15;
+	if (tile < 16)
+		tile = 16;
+
+	for (int y = 0; y < h; y += tile) {
+		for (int x = 0; x < w; x += tile) {
+			struct rect part = {
+				dst->left + x,
+				dst->top + y,
+				dst->left + (x + tile < w ? x + tile : w),
+				dst->top + (y + tile < h ? y + tile : h)
+			};
+			int part_stride = rect_width(&part) * BPP;
+			uint8_t *part_buf = reinterpret_cast<uint8_t*>(malloc(rect_height(&part) * part_stride));
+
+			if (!part_buf)
+				continue;
+
+			for (int row = 0; row < rect_height(&part); ++row)
+				memcpy(part_buf + row * part_stride,
+					   reinterpret_cast<uint8_t*>(buf) + (y + row) * stride + x * BPP,
+					   part_stride);
+
+			push_drawable(cfg, &part, part_buf, part_stride, 1);
+		}
+	}
+
+	free(buf);
+}
+
+/*
+ * Spice picks the compression per image, so mixed areas are split into
+ * text like and image like drawables. Text is what the user interacts
+ * with, image like parts are queued as bulk and let it go first.
+ */
+static void queue_split(struct display_config *cfg, const struct rect *dst, void *buf, int stride)
+{
+	struct content_rect parts[16];
+	int n = 1;
+
+	/* small updates are sent with priority whatever they show */
+	parts[0].content = CONTENT_TEXT;
+	if (rect_width(dst) > CLASSIFY_TILE || rect_height(dst) > CLASSIFY_TILE)
+		n = classify_split(reinterpret_cast<const uint8_t*>(buf), stride,
+						   rect_width(dst), rect_height(dst), parts, ARRAYSIZE(parts));
+
+	if (n <= 1) {
+		queue_drawable(cfg, dst, buf, stride, parts[0].content == CONTENT_IMAGE);
+		return;
+	}
+
+	for (int i = 0; i < n; ++i) {
+		const struct rect *r = &parts[i].rect;
+		struct rect part = { dst->left + r->left, dst->top + r->top, dst->left + r->right, dst->top + r->bottom };
+		int part_stride = rect_width(r) * BPP;
+		uint8_t *part_buf = reinterpret_cast<uint8_t*>(malloc(rect_height(r) * part_stride));
+
+		if (!part_buf)
+			continue;
+
+		for (int y = 0; y < rect_height(r); ++y)
+			memcpy(part_buf + y * part_stride,
+				   reinterpret_cast<uint8_t*>(buf) + (r->top + y) * stride + r->left * BPP,
+				   part_stride);
+
+		queue_drawable(cfg, &part, part_buf, part_stride, parts[i].content == CONTENT_IMAGE);
+	}
+
+	free(buf);
+}
+
+/*
+ * Reads the output area dirty and scales it to the surface area dst. The
+ * pixels are returned with a stride of *stride, NULL if dst is empty.
+ */
+static void *read_scaled(DX_RESOURCES *rsrc, ID3D11Texture2D *frame, const struct output *output,
+						 const struct rect *dirty, struct display_config *cfg, struct rect *dst, int *stride)
+{
+	struct rect src;
+
+	/*
+	 * src is the area the scaling filter reads, it may be larger than
+	 * the dirty rect. Without scaling both are the dirty rect.
+	 */
+	scaler_map_rect(&output->scaler, dirty, dst, &src);
+	if (rect_is_empty(dst))
+		return NULL;
+
+	void *buf = read_area(rsrc, frame, output, &cfg->tonemap, &src);
+	if (!buf)
+		return NULL;
+
+	*stride = rect_width(&src) * BPP;
+
+	if (!scaler_is_identity(&output->scaler)) {
+		void *scaled;
+
+		*stride = rect_width(dst) * BPP;
+		scaled = malloc(rect_height(dst) * *stride);
+		if (scaled)
+			scaler_scale(&output->scaler,
+						 dst, reinterpret_cast<uint8_t*>(scaled), *stride,
+						 &src, reinterpret_cast<const uint8_t*>(buf), rect_width(&src) * BPP);
+		free(buf);
+		buf = scaled;
+	}
+
+	rect_translate(dst, output->surface.left, output->surface.top);
+
+	return buf;
+}
+
+/* streams and updates in lossy mode are refined once the screen is quiet */
+static void mark_refine(struct display_config *cfg, const struct rect *dst, int video)
+{
+	g_mutex_lock(&cfg->refine_lock);
+	if (video || g_atomic_int_get(&cfg->lossy))
+		refine_mark(cfg->refine, dst);
+	else
+		refine_clear(cfg->refine, dst);
+	g_mutex_unlock(&cfg->refine_lock);
+}
+
+/*
+ * Records the surface area dst in the shadow and queues it. A video area
+ * is always sent as one drawable, spice detects streams by their bounding
+ * box. Thread safe.
+ */
+static void send_rect(struct display_config *cfg, const struct rect *dst, void *buf, int stride, int video)
+{
+	shadow_write(cfg->shadow, dst, reinterpret_cast<const uint8_t*>(buf), stride);
+
+	if (video)
+		push_drawable(cfg, dst, buf, stride, 0);
+	else if (cfg->split_content)
+		queue_split(cfg, dst, buf, stride);
+	else
+		queue_drawable(cfg, dst, buf, stride, 0);
+}
+
+/* sends the desktop area dirty to the client */
+static void ProcessRect(DX_RESOURCES *rsrc, ID3D11Texture2D *frame, const struct output *output,
+						const struct rect *dirty, int video, struct display_config *cfg)
+{
+	struct rect dst;
+	int stride;
+
+	void *buf = read_scaled(rsrc, frame, output, dirty, cfg, &dst, &stride);
+	if (!buf)
+		return;
+
+	mark_refine(cfg, &dst, video);
+	send_rect(cfg, &dst, buf, stride, video);
+}
+
+/* surface rows one scaling job computes */
+#define SCALE_JOB_ROWS 64
+
+struct scale_job {
+	struct work work;
+	const struct scaler *scaler;
+	struct rect dst;	/* a band of the rect */
+	uint8_t *pixels;
+	int stride;
+	const struct rect *src;
+	const uint8_t *src_pixels;
+	int src_stride;
+};
+
+static void scale_job_run(struct work *work)
+{
+	struct scale_job *job = reinterpret_cast<struct scale_job*>(work);
+
+	scaler_scale(job->scaler, &job->dst, job->pixels, job->stride, job->src, job->src_pixels, job->src_stride);
+}
+
+struct send_job {
+	struct work work;
+	struct display_config *cfg;
+	struct rect dst;
+	struct rect src;
+	void *raw;		/* read back desktop pixels */
+	void *buf;		/* scaled pixels, NULL if nothing is left to send */
+	int stride;
+	int video;
+	struct scale_job *bands;
+};
+
+static void send_job_run(struct work *work)
+{
+	struct send_job *job = reinterpret_cast<struct send_job*>(work);
+
+	send_rect(job->cfg, &job->dst, job->buf, job->stride, job->video);
+}
+
+/*
+ * ProcessRect for a batch of disjoint rects on the worker pool. Read back
+ * needs the D3D context and stays on this thread, scaling runs in bands
+ * meanwhile. Splitting, tiling and drawable creation follow in a second
+ * round. Both rounds are joined, so the next batch is never queued before
+ * this one. The pool is shared by all outputs, each batch only waits for
+ * its own jobs.
+ */
+static void ProcessRects(DX_RESOURCES *rsrc, ID3D11Texture2D *frame, const struct output *output,
+						 const struct rect *dirty, const int *video, int n, struct display_config *cfg)
+{
+	struct send_job jobs[VIDEO_MAX_AREAS + REGION_MAX_RECTS];
+	struct work_group group;
+	int identity = scaler_is_identity(&output->scaler);
+
+	work_group_init(&group);
+
+	for (int i = 0; i < n; ++i) {
+		struct send_job *job = &jobs[i];
+
+		job->work.run = send_job_run;
+		job->cfg = cfg;
+		job->video = video[i];
+		job->raw = NULL;
+		job->buf = NULL;
+		job->bands = NULL;
+
+		scaler_map_rect(&output->scaler, &dirty[i], &job->dst, &job->src);
+		if (rect_is_empty(&job->dst))
+			continue;
+
+		job->raw = read_area(rsrc, frame, output, &cfg->tonemap, &job->src);
+		if (!job->raw)
+			continue;
+
+		if (identity) {
+			job->buf = job->raw;
+			job->raw = NULL;
+			job->stride = rect_width(&job->src) * BPP;
+			continue;
+		}
+
+		int rows = rect_height(&job->dst);
+		int count = (rows + SCALE_JOB_ROWS - 1) / SCALE_JOB_ROWS;
+
+		job->stride = rect_width(&job->dst) * BPP;
+		job->buf = malloc(rows * job->stride);
+		job->bands = reinterpret_cast<struct scale_job*>(malloc(count * sizeof(*job->bands)));
+		if (!job->buf || !job->bands) {
+			free(job->buf);
+			job->buf = NULL;
+			continue;
+		}
+
+		for (int b = 0; b < count; ++b) {
+			struct scale_job *band = &job->bands[b];
+			int top = job->dst.top + b * SCALE_JOB_ROWS;
+
+			band->work.run = scale_job_run;
+			band->scaler = &output->scaler;
+			band->dst = job->dst;
+			band->dst.top = top;
+			band->dst.bottom = top + SCALE_JOB_ROWS < job->dst.bottom ? top + SCALE_JOB_ROWS : job->dst.bottom;
+			band->stride = job->stride;
+			band->pixels = reinterpret_cast<uint8_t*>(job->buf) + (top - job->dst.top) * job->stride;
+			band->src = &job->src;
+			band->src_pixels = reinterpret_cast<const uint8_t*>(job->raw);
+			band->src_stride = rect_width(&job->src) * BPP;
+			work_pool_push(cfg->pool, &group, &band->work);
+		}
+	}
+
+	work_group_wait(&group);
+
+	for (int i = 0; i < n; ++i) {
+		free(jobs[i].raw);
+		free(jobs[i].bands);
+		if (!jobs[i].buf)
+			continue;
+
+		rect_translate(&jobs[i].dst, output->surface.left, output->surface.top);
+		mark_refine(cfg, &jobs[i].dst, jobs[i].video);
+		work_pool_push(cfg->pool, &group, &jobs[i].work);
+	}
+
+	work_group_wait(&group);
+	work_group_clear(&group);
+}
+
+/*
+ * Damage not sent yet. While sends are deferred by the frame rate or
+ * bandwidth cap the newest pixels of it are kept in a copy of the desktop,
+ * the frame itself is released right away.
+ */
+struct damage {
+	struct region region;
+	ID3D11Texture2D *latest;
+	int deferred;		/* damage may outlive its frame, or the refresh reads the copy */
+	gint64 interval;	/* us between sends, 0 sends every frame */
+	gint64 next_send;
+	struct token_bucket bucket;
+	struct video_tracker *video;	/* NULL without streaming */
+};
+
+/*
+ * The bandwidth cap counts estimated compressed bytes. Spice's lossless
+ * codecs reach about 4:1 on typical desktop content.
+ */
+#define ESTIMATED_COMPRESSION 4
+
+/*
+ * Applies the rate cap and video tracking for the connected client. Both
+ * only pay off if spice can stream to it.
+ */
+static void damage_configure(struct damage *damage, struct display_config *cfg, struct video_tracker *video)
+{
+	int streaming = cfg->track_video && g_atomic_int_get(&cfg->client_streams);
+	int fps = streaming && cfg->stream_fps ? cfg->stream_fps : cfg->max_fps;
+	int deferred = fps || cfg->max_bandwidth || cfg->refresh_period;
+
+	damage->interval = fps > 0 ? 1000000 / fps : 0;
+	damage->video = streaming ? video : nullptr;
+
+	/* the copy is not kept up to date while sends are immediate */
+	if (deferred && !damage->deferred && damage->latest) {
+		damage->latest->Release();
+		damage->latest = nullptr;
+	}
+	damage->deferred = deferred;
+}
+
+/* us until the damage may be sent */
+static gint64 damage_delay(struct damage *damage, gint64 now)
+{
+	gint64 delay = damage->next_send > now ? damage->next_send - now : 0;
+	gint64 tokens = token_bucket_delay(&damage->bucket, now);
+
+	return tokens > delay ? tokens : delay;
+}
+
+/* mirrors the frame area tex, the whole frame when the copy is created */
+static void update_latest(DX_RESOURCES *rsrc, ID3D11Texture2D *frame, struct damage *damage, const struct rect *tex)
+{
+	if (!damage->latest) {
+		D3D11_TEXTURE2D_DESC desc;
+
+		frame->GetDesc(&desc);
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = 0;
+		desc.CPUAccessFlags = 0;
+		desc.MiscFlags = 0;
+		if (FAILED(rsrc->Device->CreateTexture2D(&desc, nullptr, &damage->latest))) {
+			printf("Failed to create desktop copy\n");
+			damage->latest = nullptr;
+			return;
+		}
 
-	assert(current_data->MoveCount == 0);
+		rsrc->Context->CopyResource(damage->latest, frame);
+		return;
+	}
+
+	D3D11_BOX box;
+	box.left = tex->left;
+	box.right = tex->right;
+	box.top = tex->top;
+	box.bottom = tex->bottom;
+	box.front = 0;
+	box.back = 1;
+
+	rsrc->Context->CopySubresourceRegion(damage->latest, 0, tex->left, tex->top, 0, frame, 0, &box);
+}
+
+static void add_damage(DX_RESOURCES *rsrc, ID3D11Texture2D *frame, const struct output *output,
+					   struct damage *damage, const struct rect *tex)
+{
+	struct rect dirty;
 
-//	printf("Dirty:\n");
-	for (unsigned int k = 0; k < current_data->DirtyCount; ++k)
+	if (damage->deferred)
+		update_latest(rsrc, frame, damage, tex);
+
+	rotation_rect_to_desktop(output->rotation, output->width, output->height, tex, &dirty);
+	region_add(&damage->region, &dirty);
+}
+
+/*
+ * Adds the damage of a frame. Overlapping move and dirty rects are merged,
+ * so every pixel is read back only once.
+ */
+void ProcessFrame(DX_RESOURCES *rsrc, FRAME_DATA *current_data, const struct output *output, struct damage *damage)
+{
+	DXGI_OUTDUPL_MOVE_RECT *pMoveRect = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(current_data->MetaData);
+	RECT *pDirtyRect = reinterpret_cast<RECT*>(current_data->MetaData + (current_data->MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT)));
+
+	/*
+	 * Move and dirty rects are in texture orientation. The destination of
+	 * a move is sent like a dirty rect, the pixels are already in place in
+	 * the frame.
+	 */
+	for (unsigned int k = 0; k < current_data->MoveCount; ++k, ++pMoveRect)
+	{
+		struct rect moved = {
+			pMoveRect->DestinationRect.left,
+			pMoveRect->DestinationRect.top,
+			pMoveRect->DestinationRect.right,
+			pMoveRect->DestinationRect.bottom
+		};
+
+		add_damage(rsrc, current_data->Frame, output, damage, &moved);
+	}
+
+	for (unsigned int k = 0; k < current_data->DirtyCount; ++k, ++pDirtyRect)
 	{
-		unsigned int w = pDirtyRect->right - pDirtyRect->left;
-		unsigned int h = pDirtyRect->bottom - pDirtyRect->top;
-		unsigned int depth = 4;
-
-#if 0
-		printf("  left %ld, top %ld, right %ld, bottom %ld, w %u, h %u\n", 
-			pDirtyRect->left,
-			pDirtyRect->top,
-			pDirtyRect->right,
-			pDirtyRect->bottom,
-			w,
-			h);
-#endif
-
-		D3D11_TEXTURE2D_DESC desc2;
-		desc2.Width = w;
-		desc2.Height = h;
-		desc2.MipLevels = desc.MipLevels;
-		desc2.ArraySize = desc.ArraySize;
-		desc2.Format = desc.Format;
-		desc2.SampleDesc = desc.SampleDesc;
-		desc2.Usage = D3D11_USAGE_STAGING;
-		desc2.BindFlags = 0;
-		desc2.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
-		desc2.MiscFlags = 0;
-
-		ID3D11Texture2D *stagingTexture;
-		hr = rsrc->Device->CreateTexture2D(&desc2, nullptr, &stagingTexture);
-		if (FAILED(hr)) {
-			printf("Failed to create staging texture\n");
+		struct rect tex = { pDirtyRect->left, pDirtyRect->top, pDirtyRect->right, pDirtyRect->bottom };
+
+		add_damage(rsrc, current_data->Frame, output, damage, &tex);
+	}
+}
+
+/* sends the accumulated damage from source, the frame or the desktop copy */
+static void SendDamage(DX_RESOURCES *rsrc, ID3D11Texture2D *source, const struct output *output,
+					   struct damage *damage, struct display_config *cfg)
+{
+	struct rect rects[VIDEO_MAX_AREAS + REGION_MAX_RECTS];
+	int video[VIDEO_MAX_AREAS + REGION_MAX_RECTS];
+	int64_t bytes = 0;
+	int n = 0;
+
+	if (region_is_empty(&damage->region))
+		return;
+
+	/* video areas first, they are taken out of the region */
+	if (damage->video)
+		n = video_tracker_update(damage->video, &damage->region, g_get_monotonic_time(), rects);
+
+	for (int i = 0; i < n; ++i)
+		video[i] = 1;
+
+	for (int i = 0; i < damage->region.count; ++i, ++n) {
+		rects[n] = damage->region.rects[i];
+		video[n] = 0;
+	}
+
+	if (cfg->pool) {
+		ProcessRects(rsrc, source, output, rects, video, n, cfg);
+	} else {
+		for (int i = 0; i < n; ++i)
+			ProcessRect(rsrc, source, output, &rects[i], video[i], cfg);
+	}
+
+	for (int i = 0; i < n; ++i)
+		bytes += rect_area(&rects[i]);
+
+	/* the damage is in desktop pixels, the client gets scaled ones */
+	bytes = bytes * BPP * output->scaler.dst_width / output->scaler.src_width *
+			output->scaler.dst_height / output->scaler.src_height / ESTIMATED_COMPRESSION;
+
+	gint64 now = g_get_monotonic_time();
+	region_init(&damage->region);
+	damage->next_send = now + damage->interval;
+	token_bucket_consume(&damage->bucket, bytes, now);
+	metrics_add(METRIC_FRAMES_SENT, 1);
+	metrics_add(METRIC_ESTIMATED_BYTES, bytes);
+}
+
+/* refinement starts after this much quiet and sends a few tiles per wakeup */
+#define REFINE_QUIET_US (500 * 1000)
+#define REFINE_INTERVAL_MS 50
+#define REFINE_CHUNK 4
+
+/*
+ * Resends tiles of the output whose last update may have been lossy from
+ * the shadow framebuffer, closest to the pointer first. Only a few tiles
+ * go out per call, so new activity is never held up for long.
+ */
+static void RefineTiles(const struct output *output, struct display_config *cfg)
+{
+	struct rect tile;
+	int x, y;
+
+	g_mutex_lock(cfg->draw_lock);
+	x = cfg->draw_queue->focus_x;
+	y = cfg->draw_queue->focus_y;
+	g_mutex_unlock(cfg->draw_lock);
+
+	for (int i = 0; i < REFINE_CHUNK; ++i) {
+		g_mutex_lock(&cfg->refine_lock);
+		int found = refine_next(cfg->refine, &output->surface, x, y, &tile);
+		g_mutex_unlock(&cfg->refine_lock);
+		if (!found)
+			break;
+
+		int stride = rect_width(&tile) * BPP;
+		uint8_t *buf = reinterpret_cast<uint8_t*>(malloc(rect_height(&tile) * stride));
+
+		if (!buf)
+			continue;
+
+		shadow_read(cfg->shadow, &tile, buf, stride);
+		push_drawable(cfg, &tile, buf, stride, 0);
+		metrics_add(METRIC_REFINE_BYTES, rect_height(&tile) * stride);
+	}
+}
+
+/* the refresh compares a band of the screen per tick, tiles that differ are resent */
+#define REFRESH_INTERVAL_US (250 * 1000)
+#define REFRESH_TILE 64
+
+/* position of the rolling refresh, period 0 disables it */
+struct refresh {
+	int period;		/* s for the whole screen */
+	int row;		/* next desktop row */
+	gint64 next;
+};
+
+static int refresh_due(const struct refresh *refresh, struct damage *damage, gint64 now)
+{
+	return refresh->period && damage->latest && region_is_empty(&damage->region) &&
+		   now >= refresh->next && !damage_delay(damage, now);
+}
+
+/*
+ * Compares the next band of the desktop copy with the shadow framebuffer,
+ * which holds what was sent, and resends the tiles where the two drifted
+ * apart. Only runs while all damage is sent, so the copy is not ahead of
+ * the shadow.
+ */
+static void RefreshBand(DX_RESOURCES *rsrc, ID3D11Texture2D *source, const struct output *output,
+						struct refresh *refresh, struct damage *damage, struct display_config *cfg)
+{
+	struct rect dst;
+	int stride;
+	int64_t bytes = 0;
+
+	/* rows per tick for one pass per period, rounded to the compressors' blocks */
+	int band = static_cast<int>((static_cast<int64_t>(output->height) * REFRESH_INTERVAL_US +
+								 refresh->period * 1000000LL - 1) / (refresh->period * 1000000LL));
+	band = (band + 15) & ~15;
+
+	struct rect dirty = {
+		0,
+		refresh->row,
+		output->width,
+		refresh->row + band < output->height ? refresh->row + band : output->height
+	};
+
+	refresh->row = dirty.bottom < output->height ? dirty.bottom : 0;
+	refresh->next = g_get_monotonic_time() + REFRESH_INTERVAL_US;
+
+	uint8_t *buf = reinterpret_cast<uint8_t*>(read_scaled(rsrc, source, output, &dirty, cfg, &dst, &stride));
+	if (!buf)
+		return;
+
+	for (int y = dst.top; y < dst.bottom; y += REFRESH_TILE) {
+		for (int x = dst.left; x < dst.right; x += REFRESH_TILE) {
+			struct rect tile = {
+				x,
+				y,
+				x + REFRESH_TILE < dst.right ? x + REFRESH_TILE : dst.right,
+				y + REFRESH_TILE < dst.bottom ? y + REFRESH_TILE : dst.bottom
+			};
+			const uint8_t *pixels = buf + (y - dst.top) * stride + (x - dst.left) * BPP;
+
+			if (!shadow_differs(cfg->shadow, &tile, pixels, stride))
+				continue;
+
+			int tile_stride = rect_width(&tile) * BPP;
+			uint8_t *tile_buf = reinterpret_cast<uint8_t*>(malloc(rect_height(&tile) * tile_stride));
+
+			if (!tile_buf)
+				continue;
+
+			for (int row = 0; row < rect_height(&tile); ++row)
+				memcpy(tile_buf + row * tile_stride, pixels + row * stride, tile_stride);
+
+			shadow_write(cfg->shadow, &tile, tile_buf, tile_stride);
+			mark_refine(cfg, &tile, 0);
+
+			push_drawable(cfg, &tile, tile_buf, tile_stride, 1);
+			bytes += rect_height(&tile) * tile_stride;
+			metrics_add(METRIC_REFRESH_TILES, 1);
 		}
+	}
+
+	free(buf);
 
-		D3D11_BOX sourceRegion;
-		sourceRegion.left = pDirtyRect->left;
-		sourceRegion.right = pDirtyRect->right;
-		sourceRegion.top = pDirtyRect->top;
-		sourceRegion.bottom = pDirtyRect->bottom;
-		sourceRegion.front = 0;
-		sourceRegion.back = 1;
-
-		rsrc->Context->CopySubresourceRegion(stagingTexture, 0, 0, 0, 0, current_data->Frame, 0, &sourceRegion);
-
-		D3D11_MAPPED_SUBRESOURCE *mapInfo = new D3D11_MAPPED_SUBRESOURCE;
-		hr = rsrc->Context->Map(
-				stagingTexture,
-				0,
-				D3D11_MAP_READ,
-				0,
-				mapInfo);
-		if (FAILED(hr)) {
-			printf("Failed to map staging texture\n");
+	metrics_add(METRIC_REFRESH_BYTES, bytes);
+	token_bucket_consume(&damage->bucket, bytes / ESTIMATED_COMPRESSION, g_get_monotonic_time());
+}
+
+/* tile size of the full frame, a multiple of the compressors' 16 pixel blocks */
+#define BOOTSTRAP_TILE 256
+
+/*
+ * Sends the whole shadow framebuffer to a newly connected client. The
+ * tiles are ordinary drawables, the scheduler sends the ones around the
+ * pointer first and keeps them behind older overlapping updates.
+ */
+void display_bootstrap(struct display_config *cfg)
+{
+	struct shadow *shadow = cfg->shadow;
+
+	/* the extra reference keeps the count above zero while tiles are queued */
+	if (g_atomic_int_add(&cfg->bootstrap_pending, 1) == 0)
+		cfg->bootstrap_start = g_get_monotonic_time();
+	metrics_add(METRIC_BOOTSTRAPS, 1);
+
+	for (int y = 0; y < shadow->height; y += BOOTSTRAP_TILE) {
+		for (int x = 0; x < shadow->width; x += BOOTSTRAP_TILE) {
+			struct rect tile = {
+				x,
+				y,
+				x + BOOTSTRAP_TILE < shadow->width ? x + BOOTSTRAP_TILE : shadow->width,
+				y + BOOTSTRAP_TILE < shadow->height ? y + BOOTSTRAP_TILE : shadow->height
+			};
+			int stride = rect_width(&tile) * BPP;
+			uint8_t *buf = reinterpret_cast<uint8_t*>(malloc(rect_height(&tile) * stride));
+
+			if (!buf)
+				continue;
+
+			shadow_read(shadow, &tile, buf, stride);
+
+			QXLDrawable *drawable = create_drawable(cfg, tile.left, tile.top, rect_width(&tile), rect_height(&tile),
+													stride, buf);
+			if (!drawable) {
+				free(buf);
+				continue;
+			}
+
+			reinterpret_cast<struct draw_asset*>(drawable->release_info.id)->bootstrap = 1;
+			g_atomic_int_inc(&cfg->bootstrap_pending);
+			schedule_drawable(cfg, &tile, drawable, 0);
 		}
+	}
 
-		void *buf = malloc(h * mapInfo->RowPitch);
-		memcpy(buf, mapInfo->pData, h * mapInfo->RowPitch);
+	if (g_atomic_int_dec_and_test(&cfg->bootstrap_pending))
+		metrics_set(METRIC_FIRST_FRAME_MS, (g_get_monotonic_time() - cfg->bootstrap_start) / 1000);
+}
 
-		QXLDrawable *drawable = create_drawable(
-			pDirtyRect->left,
-			pDirtyRect->top,
-			w,
-			h,
-			mapInfo->RowPitch,
-			buf,
-			buf);
+void display_input(struct display_config *cfg)
+{
+	g_atomic_int_inc(&cfg->input);
+}
 
-		rsrc->Context->Unmap(stagingTexture, 0);
+void display_client_connected(struct display_config *cfg)
+{
+	g_mutex_lock(&cfg->client_lock);
+	if (!cfg->clients++)
+		g_cond_broadcast(&cfg->client_cond);
+	g_mutex_unlock(&cfg->client_lock);
+}
 
-		stagingTexture->Release();
+void display_client_disconnected(struct display_config *cfg)
+{
+	g_mutex_lock(&cfg->client_lock);
+	if (cfg->clients > 0)
+		cfg->clients--;
+	g_mutex_unlock(&cfg->client_lock);
+}
 
-		g_async_queue_push(draw_queue, drawable);
+/*
+ * Blocks while no client is connected. No frame is held meanwhile, DXGI
+ * accumulates the dirty rects and reports them once capture resumes.
+ */
+static void wait_for_clients(struct display_config *cfg)
+{
+	g_mutex_lock(&cfg->client_lock);
+	if (!cfg->clients) {
+		gint64 start = g_get_monotonic_time();
+
+		metrics_set(METRIC_CAPTURING, 0);
+		while (!cfg->clients && !g_atomic_int_get(&cfg->restart))
+			g_cond_wait(&cfg->client_cond, &cfg->client_lock);
+		metrics_add(METRIC_PAUSED_MS, (g_get_monotonic_time() - start) / 1000);
+		metrics_set(METRIC_CAPTURING, 1);
+	}
+	g_mutex_unlock(&cfg->client_lock);
+}
 
-		spice_qxl_wakeup(display_sin);
+/* reasons for a restart, the first one reported wins */
+#define RESTART_LOST 1		/* a running duplication was lost */
+#define RESTART_INIT 2		/* a duplication could not be created */
 
-		pDirtyRect++;
+/* asks the supervisor to stop all capture threads and start them again */
+static void capture_lost(struct display_config *cfg, int reason)
+{
+	g_mutex_lock(&cfg->restart_lock);
+	if (!cfg->restart) {
+		g_atomic_int_set(&cfg->restart, reason);
+		g_cond_broadcast(&cfg->restart_cond);
 	}
+	g_mutex_unlock(&cfg->restart_lock);
 }
 
 void release_asset(void *data)
 {
-	free(data);
+	struct asset *asset = reinterpret_cast<struct asset*>(data);
+
+	asset->release(asset);
 }
 
-gpointer display(gpointer data)
+/* AcquireNextFrame timeouts in ms, short for a second after activity */
+#define FRAME_TIMEOUT_MIN 16
+#define FRAME_TIMEOUT_MAX 1000
+#define FRAME_TIMEOUT_ACTIVE 1000
+
+/*
+ * Enumerates the outputs attached to the desktop and places them on the
+ * primary surface. Only outputs of the adapter InitializeDx picks can be
+ * duplicated, which is the first one.
+ */
+int display_layout(const struct display_config *cfg, struct layout *layout)
 {
-	struct display_config *cfg = reinterpret_cast<struct display_config*>(data);
+	struct layout_output outputs[LAYOUT_MAX_OUTPUTS];
+	ID3D11Device *device;
+	IDXGIDevice *dxgi_device;
+	IDXGIAdapter *adapter;
+	IDXGIOutput *dxgi_output;
+	HRESULT hr;
+	int count = 0;
+
+	hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, nullptr, 0,
+						   D3D11_SDK_VERSION, &device, nullptr, nullptr);
+	if (FAILED(hr)) {
+		fprintf(stderr, "Failed to create device for output enumeration: 0x%lx\n", hr);
+		return -1;
+	}
+
+	hr = device->QueryInterface(__uuidof(IDXGIDevice), reinterpret_cast<void**>(&dxgi_device));
+	device->Release();
+	if (FAILED(hr))
+		return -1;
+
+	hr = dxgi_device->GetParent(__uuidof(IDXGIAdapter), reinterpret_cast<void**>(&adapter));
+	dxgi_device->Release();
+	if (FAILED(hr))
+		return -1;
+
+	for (UINT i = 0; count < LAYOUT_MAX_OUTPUTS && SUCCEEDED(adapter->EnumOutputs(i, &dxgi_output)); ++i) {
+		DXGI_OUTPUT_DESC desc;
+
+		dxgi_output->GetDesc(&desc);
+		dxgi_output->Release();
+		if (!desc.AttachedToDesktop)
+			continue;
+
+		outputs[count].id = i;
+		outputs[count].desktop.left = desc.DesktopCoordinates.left;
+		outputs[count].desktop.top = desc.DesktopCoordinates.top;
+		outputs[count].desktop.right = desc.DesktopCoordinates.right;
+		outputs[count].desktop.bottom = desc.DesktopCoordinates.bottom;
+		printf("output %u: %ls (%ld,%ld)-(%ld,%ld)\n", i, desc.DeviceName,
+			   desc.DesktopCoordinates.left, desc.DesktopCoordinates.top,
+			   desc.DesktopCoordinates.right, desc.DesktopCoordinates.bottom);
+		count++;
+	}
+	adapter->Release();
+
+	return layout_init(layout, outputs, count, cfg->scale_width, cfg->scale_height);
+}
+
+/* captures one output of the layout */
+static gpointer display(gpointer data)
+{
+	struct capture *capture = reinterpret_cast<struct capture*>(data);
+	struct display_config *cfg = capture->cfg;
+	struct pointer *pointer = capture->pointer;
 	DUPLICATIONMANAGER mgr;
 	DUPL_RETURN ret;
-	DX_RESOURCES rsrc;
+	DX_RESOURCES rsrc = {};
 
 	ret = InitializeDx(&rsrc);
 	if (ret != DUPL_RETURN_SUCCESS)
 	{
 		fprintf(stderr, "InitializeDx returned %d\n", ret);
-		exit(EXIT_FAILURE);
+		ReleaseDx(&rsrc);
+		capture_lost(cfg, RESTART_INIT);
+		return 0;
 	}
 
-	ret = mgr.InitDupl(rsrc.Device, 0);
+	ret = mgr.InitDupl(rsrc.Device, capture->layout->id, cfg->hdr);
 	if (ret != DUPL_RETURN_SUCCESS)
 	{
 		fprintf(stderr, "InitDupl returned %d\n", ret);
-		exit(EXIT_FAILURE);
+		ReleaseDx(&rsrc);
+		capture_lost(cfg, RESTART_INIT);
+		return 0;
+	}
+
+	DXGI_OUTPUT_DESC output_desc;
+	struct output output;
+
+	mgr.GetOutputDesc(&output_desc);
+	output.width = output_desc.DesktopCoordinates.right - output_desc.DesktopCoordinates.left;
+	output.height = output_desc.DesktopCoordinates.bottom - output_desc.DesktopCoordinates.top;
+	output.surface = capture->layout->surface;
+
+	/* the mode changed again since the outputs were enumerated */
+	if (output.width != rect_width(&capture->layout->desktop) ||
+		output.height != rect_height(&capture->layout->desktop))
+	{
+		ReleaseDx(&rsrc);
+		capture_lost(cfg, RESTART_LOST);
+		return 0;
+	}
+
+	if (scaler_init(&output.scaler, output.width, output.height,
+					rect_width(&output.surface), rect_height(&output.surface), cfg->scale_filter) < 0)
+	{
+		fprintf(stderr, "invalid scale %dx%d\n", rect_width(&output.surface), rect_height(&output.surface));
+		ReleaseDx(&rsrc);
+		capture_lost(cfg, RESTART_INIT);
+		return 0;
+	}
+
+	g_mutex_lock(&cfg->restart_lock);
+	int64_t recovered = recovery_succeeded(&cfg->recovery, g_get_monotonic_time());
+	g_mutex_unlock(&cfg->restart_lock);
+	if (recovered >= 0) {
+		printf("capture recovered after %lld ms\n", (long long) recovered / 1000);
+		metrics_set(METRIC_TRANSITION_MS, recovered / 1000);
+	}
+
+	switch (output_desc.Rotation) {
+	case DXGI_MODE_ROTATION_ROTATE90:
+		output.rotation = ROTATION_90;
+		break;
+	case DXGI_MODE_ROTATION_ROTATE180:
+		output.rotation = ROTATION_180;
+		break;
+	case DXGI_MODE_ROTATION_ROTATE270:
+		output.rotation = ROTATION_270;
+		break;
+	default:
+		output.rotation = ROTATION_0;
+		break;
 	}
 
-	bool quit = false;
 	FRAME_DATA current_data;
+	struct idle_policy idle;
+	struct damage damage;
+	struct video_tracker video;
+	struct refresh refresh;
+	int input = g_atomic_int_get(&cfg->input);
+	/* the outputs share the bandwidth cap */
+	int64_t bandwidth = cfg->max_bandwidth / cfg->layout.count;
+
+	idle_policy_init(&idle, FRAME_TIMEOUT_MIN, FRAME_TIMEOUT_MAX, FRAME_TIMEOUT_ACTIVE);
+	region_init(&damage.region);
+	damage.latest = nullptr;
+	damage.deferred = 0;
+	damage.next_send = 0;
+	token_bucket_init(&damage.bucket, bandwidth, bandwidth / 4, g_get_monotonic_time());
+	damage_configure(&damage, cfg, &video);
+	refresh.period = cfg->refresh_period;
+	refresh.row = 0;
+	refresh.next = 0;
+	video_tracker_init(&video);
+
+	while (!g_atomic_int_get(&cfg->restart)) {
+		wait_for_clients(cfg);
+		if (g_atomic_int_get(&cfg->restart))
+			break;
+		damage_configure(&damage, cfg, &video);
+
+		/*
+		 * A slow client keeps spice from releasing our drawables. Ask it to
+		 * drop some and leave new frames to DXGI meanwhile, it merges their
+		 * dirty rects until capture resumes.
+		 */
+		if (mem_budget_exhausted(cfg->budget)) {
+			gint64 start = g_get_monotonic_time();
+
+			do {
+				metrics_add(METRIC_OOM, 1);
+				spice_qxl_oom(cfg->display_sin);
+			} while (!mem_budget_wait(cfg->budget, 100 * 1000) && !g_atomic_int_get(&cfg->restart));
+
+			metrics_add(METRIC_THROTTLED_MS, (g_get_monotonic_time() - start) / 1000);
+		}
+
+		gint64 now = g_get_monotonic_time();
+		if (g_atomic_int_get(&cfg->input) != input) {
+			input = g_atomic_int_get(&cfg->input);
+			idle_policy_activity(&idle, now);
+		}
+
+		UINT timeout = idle_policy_timeout(&idle, now);
+
+		/* deferred damage has to go out on time even without further frames */
+		if (!region_is_empty(&damage.region)) {
+			gint64 wait = (damage_delay(&damage, now) + 999) / 1000;
+			if (wait < timeout)
+				timeout = static_cast<UINT>(wait);
+		}
+
+		g_mutex_lock(&cfg->refine_lock);
+		int refining = refine_pending(cfg->refine) && !g_atomic_int_get(&cfg->lossy);
+		g_mutex_unlock(&cfg->refine_lock);
+		if (refining && timeout > REFINE_INTERVAL_MS)
+			timeout = REFINE_INTERVAL_MS;
+
+		/* the refresh waits for all damage to go out first */
+		if (refresh.period && damage.latest && region_is_empty(&damage.region)) {
+			gint64 due = refresh.next > now ? refresh.next - now : 0;
+			gint64 delay = damage_delay(&damage, now);
+			gint64 wait = ((due > delay ? due : delay) + 999) / 1000;
+			if (wait < timeout)
+				timeout = static_cast<UINT>(wait);
+		}
 
-	while( quit == false ) {
 		bool TimeOut;
-		ret = mgr.GetFrame(&current_data, &TimeOut);
+		ret = mgr.GetFrame(&current_data, &TimeOut, timeout);
+		metrics_add(METRIC_WAKEUPS, 1);
 		if (ret != DUPL_RETURN_SUCCESS)
 		{
-			// An error occurred getting the next frame drop out of loop which
-			// will check if it was expected or not
+			// Mode changes and desktop switches invalidate the duplication,
+			// all outputs are set up again
+			capture_lost(cfg, RESTART_LOST);
 			break;
 		}
 
@@ -391,22 +1414,193 @@ gpointer display(gpointer data)
 		if (TimeOut)
 		{
 			// No new frame at the moment
+			gint64 now = g_get_monotonic_time();
+			if (damage.latest && !damage_delay(&damage, now))
+				SendDamage(&rsrc, damage.latest, &output, &damage, cfg);
+			else if (refining && region_is_empty(&damage.region) &&
+					 now - idle.last_activity >= REFINE_QUIET_US)
+				RefineTiles(&output, cfg);
+
+			if (refresh_due(&refresh, &damage, now))
+				RefreshBand(&rsrc, damage.latest, &output, &refresh, &damage, cfg);
 			continue;
 		}
 
-		ProcessFrame(&rsrc, &current_data, cfg->draw_queue, cfg->display_sin);
-
-		PTR_INFO ptr_info;
-		memset(&ptr_info, 0, sizeof(ptr_info));
+		idle_policy_activity(&idle, g_get_monotonic_time());
 
-		ret = mgr.GetMouse(&ptr_info, &current_data.FrameInfo, 0, 0);
+		g_mutex_lock(&pointer->lock);
+		ret = mgr.GetMouse(&pointer->info, &current_data.FrameInfo, 0, 0);
 		if (ret == DUPL_RETURN_SUCCESS)
-			ProcessPointer(&ptr_info, cfg->cursor_queue);
+			ProcessPointer(&pointer->info, &current_data.FrameInfo, &pointer->cache, cfg);
+		g_mutex_unlock(&pointer->lock);
+
+		ProcessFrame(&rsrc, &current_data, &output, &damage);
+
+		if (!damage.deferred)
+			SendDamage(&rsrc, current_data.Frame, &output, &damage, cfg);
+		else if (damage.latest && !damage_delay(&damage, g_get_monotonic_time()))
+			SendDamage(&rsrc, damage.latest, &output, &damage, cfg);
+		else
+			metrics_add(METRIC_ACCUMULATED_FRAMES, 1);
+
+		if (refresh_due(&refresh, &damage, g_get_monotonic_time()))
+			RefreshBand(&rsrc, damage.latest, &output, &refresh, &damage, cfg);
 
 		mgr.DoneWithFrame();
+	}
+
+	if (damage.latest)
+		damage.latest->Release();
+	scaler_cleanup(&output.scaler);
+	ReleaseDx(&rsrc);
+
+	return 0;
+}
+
+/* drops queued drawables, they were placed on the old surface */
+static void flush_draw_queue(struct display_config *cfg)
+{
+	void *drawable;
+
+	g_mutex_lock(cfg->draw_lock);
+	while ((drawable = scheduler_pop(cfg->draw_queue, g_get_monotonic_time(), NULL)) != NULL) {
+		QXLDrawable *d = reinterpret_cast<QXLDrawable*>(drawable);
+
+		g_mutex_unlock(cfg->draw_lock);
+		release_asset(reinterpret_cast<void*>(d->release_info.id));
+		g_mutex_lock(cfg->draw_lock);
+	}
+	g_mutex_unlock(cfg->draw_lock);
+}
+
+/* the supervisor's side of recovery_retry */
+struct restart_attempt {
+	struct display_config *cfg;
+	struct layout *layout;
+	int reason;
+};
+
+static int restart_try(void *data)
+{
+	struct restart_attempt *attempt = reinterpret_cast<struct restart_attempt*>(data);
+
+	/* during a mode change the outputs may be briefly detached */
+	if (display_layout(attempt->cfg, attempt->layout) == 0)
+		return 0;
+
+	attempt->reason = RESTART_INIT;
+	return -1;
+}
+
+static void restart_wait(void *data, int64_t us)
+{
+	struct restart_attempt *attempt = reinterpret_cast<struct restart_attempt*>(data);
+
+	printf("capture %s, retrying in %lld ms\n", attempt->reason == RESTART_LOST ? "lost" : "failed",
+		   (long long) us / 1000);
+	metrics_add(METRIC_RECOVERY_FAILURES, 1);
+	metrics_set(METRIC_BACKOFF_MS, us / 1000);
+	g_usleep(us);
+}
 
-		free(ptr_info.PtrShapeBuffer);
+static int64_t restart_now(void *)
+{
+	return g_get_monotonic_time();
+}
+
+/*
+ * Mode changes, output hotplug and desktop switches invalidate every
+ * duplication. The capture threads report it and exit, the supervisor
+ * enumerates the outputs again and, if the layout changed, has the primary
+ * surface re-created before starting them over. The first frame of a new
+ * duplication covers the whole output, which repaints the clients.
+ */
+static gpointer supervise(gpointer data)
+{
+	struct display_config *cfg = reinterpret_cast<struct display_config*>(data);
+	static struct pointer pointer;
+	static struct capture captures[LAYOUT_MAX_OUTPUTS];
+	GThread *threads[LAYOUT_MAX_OUTPUTS];
+
+	/* kept across frames, GetMouse reuses the shape buffer */
+	g_mutex_init(&pointer.lock);
+	memset(&pointer.info, 0, sizeof(pointer.info));
+	cursor_cache_init(&pointer.cache);
+
+	for (;;) {
+		struct layout layout;
+		int count = cfg->layout.count;
+		int64_t delay;
+		int reason;
+
+		for (int i = 0; i < count; ++i) {
+			captures[i].cfg = cfg;
+			captures[i].layout = &cfg->layout.outputs[i];
+			captures[i].pointer = &pointer;
+			threads[i] = g_thread_new("display", display, &captures[i]);
+		}
+
+		g_mutex_lock(&cfg->restart_lock);
+		while (!cfg->restart)
+			g_cond_wait(&cfg->restart_cond, &cfg->restart_lock);
+		reason = cfg->restart;
+		delay = recovery_failed(&cfg->recovery, g_get_monotonic_time(), reason == RESTART_LOST);
+		g_mutex_unlock(&cfg->restart_lock);
+
+		/* wakes threads waiting for a client */
+		g_mutex_lock(&cfg->client_lock);
+		g_cond_broadcast(&cfg->client_cond);
+		g_mutex_unlock(&cfg->client_lock);
+		for (int i = 0; i < count; ++i)
+			g_thread_join(threads[i]);
+
+		/*
+		 * The next attempt starts with new devices. The capture threads
+		 * are gone, nothing else touches the recovery state meanwhile.
+		 */
+		struct restart_attempt attempt = { cfg, &layout, reason };
+		struct recovery_source source = { &attempt, restart_try, restart_wait, restart_now };
+		recovery_retry(&cfg->recovery, delay, &source);
+
+		if (!layout_equal(&layout, &cfg->layout)) {
+			printf("layout changed to %dx%d\n", layout.width, layout.height);
+			flush_draw_queue(cfg);
+			cfg->resize(cfg, &layout);
+
+			g_mutex_lock(&cfg->refine_lock);
+			refine_cleanup(cfg->refine);
+			if (refine_init(cfg->refine, cfg->shadow->width, cfg->shadow->height) < 0)
+			{
+				fprintf(stderr, "refine_init failed\n");
+				exit(EXIT_FAILURE);
+			}
+			g_mutex_unlock(&cfg->refine_lock);
+			metrics_add(METRIC_RESIZES, 1);
+		}
+
+		metrics_add(METRIC_RESTARTS, 1);
+		g_atomic_int_set(&cfg->restart, 0);
 	}
 
 	return 0;
 }
+
+/* starts a capture thread for every output of the layout */
+void display_start(struct display_config *cfg)
+{
+	static struct refine_map refine;
+
+	if (refine_init(&refine, cfg->shadow->width, cfg->shadow->height) < 0)
+	{
+		fprintf(stderr, "refine_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+	g_mutex_init(&cfg->refine_lock);
+	cfg->refine = &refine;
+
+	g_mutex_init(&cfg->restart_lock);
+	g_cond_init(&cfg->restart_cond);
+	recovery_init(&cfg->recovery);
+
+	g_thread_new("supervise", supervise, cfg);
+}
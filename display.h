@@ -1,9 +1,71 @@
 #pragma once
 
+#include "asset.h"
+#include "budget.h"
+#include "cursor.h"
+#include "hdr.h"
+#include "layout.h"
+#include "metrics.h"
+#include "pool.h"
+#include "recover.h"
+#include "refine.h"
+#include "scale.h"
+#include "schedule.h"
+#include "shadow.h"
+
 struct display_config {
 	QXLInstance *display_sin;
-	GAsyncQueue *draw_queue;
-	GAsyncQueue *cursor_queue;
+	GMutex *draw_lock;
+	struct scheduler *draw_queue;
+	struct cursor_channel *cursor;
+	struct shadow *shadow;
+	struct mem_budget *budget;
+	/* shared by the capture threads */
+	GMutex refine_lock;
+	struct refine_map *refine;
+	struct work_pool *pool;		/* NULL prepares updates on the display thread */
+	/* set while compression may be lossy */
+	gint lossy;
+	/*
+	 * outputs on the primary surface, scaled to scale_width x scale_height
+	 * if set. Changed under layout_lock while no capture thread runs.
+	 */
+	GMutex layout_lock;
+	struct layout layout;
+	int scale_width;
+	int scale_height;
+	enum scale_filter scale_filter;
+	struct tonemap tonemap;
+	int hdr;
+	int split_content;
+	int max_drawable_size;
+	int max_fps;
+	int track_video;
+	int stream_fps;		/* replaces max_fps while streaming, 0 keeps it */
+	/* cleared while the client decodes none of the server's video codecs */
+	gint client_streams;
+	int64_t max_bandwidth;	/* bytes per second */
+	int refresh_period;		/* s per rolling refresh of the whole screen, 0 for none */
+	/* capture pauses while no client is connected */
+	GMutex client_lock;
+	GCond client_cond;
+	int clients;
+	/* counts input events, shortens the frame timeout */
+	gint input;
+	/* spice's multimedia clock, last value and when it was set */
+	GMutex mm_lock;
+	uint32_t mm_time;
+	gint64 mm_time_base;
+	/* set by a capture thread that lost its duplication, all of them are restarted */
+	GMutex restart_lock;
+	GCond restart_cond;
+	gint restart;
+	struct recovery recovery;
+	/* publishes a changed layout and re-creates the primary surface, blocks */
+	void (*resize)(struct display_config *cfg, const struct layout *layout);
+	/* full frame tiles not yet released by spice */
+	gint bootstrap_pending;
+	gint64 bootstrap_start;
 };
 
 #ifdef __cplusplus
@@ -11,8 +73,13 @@ extern "C"
 {
 #endif
 
-void release_asset(void *asset);
-gpointer display(gpointer data);
+int display_layout(const struct display_config *cfg, struct layout *layout);
+void display_start(struct display_config *cfg);
+void display_bootstrap(struct display_config *cfg);
+void display_input(struct display_config *cfg);
+void display_set_mm_time(struct display_config *cfg, uint32_t mm_time);
+void display_client_connected(struct display_config *cfg);
+void display_client_disconnected(struct display_config *cfg);
 
 #ifdef __cplusplus
 } // extern "C"
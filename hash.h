@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* murmur3 finalizer */
+static inline uint64_t hash_mix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+
+	return h;
+}
+
+/* fast non-cryptographic hash, eight bytes per step */
+static inline uint64_t hash64(const void *data, size_t size, uint64_t seed)
+{
+	const uint8_t *p = (const uint8_t *) data;
+	uint64_t h = seed ^ (size * 0x9e3779b97f4a7c15ull);
+	uint64_t v;
+
+	for (; size >= 8; size -= 8, p += 8) {
+		memcpy(&v, p, sizeof(v));
+		h = (h ^ hash_mix64(v)) * 0x9e3779b97f4a7c15ull;
+	}
+
+	if (size) {
+		v = 0;
+		memcpy(&v, p, size);
+		h = (h ^ hash_mix64(v)) * 0x9e3779b97f4a7c15ull;
+	}
+
+	return hash_mix64(h);
+}
@@ -0,0 +1,136 @@
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "hdr.h"
+
+static float srgb_encode(float linear)
+{
+	if (linear <= 0.0031308f)
+		return 12.92f * linear;
+
+	return 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+}
+
+void tonemap_init(struct tonemap *tonemap, float sdr_white_nits)
+{
+	int i;
+
+	if (sdr_white_nits <= 0.0f)
+		sdr_white_nits = HDR_SCRGB_WHITE_NITS;
+
+	tonemap->scale = HDR_SCRGB_WHITE_NITS / sdr_white_nits;
+
+	for (i = 0; i < TONEMAP_LUT_SIZE; ++i)
+		tonemap->lut[i] = (uint8_t) (srgb_encode((float) i / (TONEMAP_LUT_SIZE - 1)) * 255.0f + 0.5f);
+}
+
+#ifdef __SSE2__
+/* four halfs in the low 16 bit of each lane, see ryg's half_to_float_SSE2 */
+static inline __m128 half_to_float(__m128i h)
+{
+	const __m128i mask_nosign = _mm_set1_epi32(0x7fff);
+	const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+	const __m128i was_infnan = _mm_set1_epi32(0x7bff);
+	const __m128 exp_infnan = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+	__m128i expmant = _mm_and_si128(mask_nosign, h);
+	__m128i justsign = _mm_xor_si128(h, expmant);
+	__m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), magic);
+	__m128 infnan = _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(expmant, was_infnan)), exp_infnan);
+	__m128 sign = _mm_castsi128_ps(_mm_slli_epi32(justsign, 16));
+
+	return _mm_or_ps(scaled, _mm_or_ps(sign, infnan));
+}
+
+static inline __m128i tonemap_index(const struct tonemap *tonemap, __m128 v)
+{
+	/* max() also turns NaN into 0, min() clips highlights and infinity */
+	v = _mm_max_ps(_mm_mul_ps(v, _mm_set1_ps(tonemap->scale)), _mm_setzero_ps());
+	v = _mm_min_ps(v, _mm_set1_ps(1.0f));
+
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(TONEMAP_LUT_SIZE - 1)), _mm_set1_ps(0.5f)));
+}
+
+static void tonemap_row(const struct tonemap *tonemap, const uint16_t *src, uint32_t *dst, int width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int32_t idx[8];
+	int x = 0;
+
+	for (; x + 2 <= width; x += 2) {
+		__m128i h = _mm_loadu_si128((const __m128i *) (src + 4 * x));
+
+		_mm_storeu_si128((__m128i *) idx, tonemap_index(tonemap, half_to_float(_mm_unpacklo_epi16(h, zero))));
+		_mm_storeu_si128((__m128i *) (idx + 4), tonemap_index(tonemap, half_to_float(_mm_unpackhi_epi16(h, zero))));
+
+		dst[x] = 0xff000000u | (tonemap->lut[idx[0]] << 16) | (tonemap->lut[idx[1]] << 8) | tonemap->lut[idx[2]];
+		dst[x + 1] = 0xff000000u | (tonemap->lut[idx[4]] << 16) | (tonemap->lut[idx[5]] << 8) | tonemap->lut[idx[6]];
+	}
+
+	if (x < width) {
+		__m128i h = _mm_loadl_epi64((const __m128i *) (src + 4 * x));
+
+		_mm_storeu_si128((__m128i *) idx, tonemap_index(tonemap, half_to_float(_mm_unpacklo_epi16(h, zero))));
+		dst[x] = 0xff000000u | (tonemap->lut[idx[0]] << 16) | (tonemap->lut[idx[1]] << 8) | tonemap->lut[idx[2]];
+	}
+}
+#else
+static float half_to_float(uint16_t h)
+{
+	uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+	uint32_t expmant = h & 0x7fff;
+	uint32_t bits;
+	float f;
+
+	if (expmant >= 0x7c00) {
+		bits = sign | 0x7f800000u | (expmant & 0x3ff) << 13;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	/* rebias the exponent, also handles denormals */
+	bits = expmant << 13;
+	memcpy(&f, &bits, sizeof(f));
+	f *= 5.192296858534828e+33f;	/* 2^(127 - 15) */
+
+	return sign ? -f : f;
+}
+
+static uint8_t tonemap_channel(const struct tonemap *tonemap, uint16_t h)
+{
+	float v = half_to_float(h) * tonemap->scale;
+
+	if (!(v > 0.0f))
+		v = 0.0f;
+	if (v > 1.0f)
+		v = 1.0f;
+
+	return tonemap->lut[(int) (v * (TONEMAP_LUT_SIZE - 1) + 0.5f)];
+}
+
+static void tonemap_row(const struct tonemap *tonemap, const uint16_t *src, uint32_t *dst, int width)
+{
+	int x;
+
+	for (x = 0; x < width; ++x, src += 4)
+		dst[x] = 0xff000000u |
+			(tonemap_channel(tonemap, src[0]) << 16) |
+			(tonemap_channel(tonemap, src[1]) << 8) |
+			tonemap_channel(tonemap, src[2]);
+}
+#endif
+
+void tonemap_copy(const struct tonemap *tonemap,
+				  const uint8_t *src, int src_stride, int width, int height,
+				  uint8_t *dst, int dst_stride)
+{
+	int y;
+
+	for (y = 0; y < height; ++y)
+		tonemap_row(tonemap, (const uint16_t *) (src + y * src_stride),
+					(uint32_t *) (dst + y * dst_stride), width);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* scRGB reference white, 1.0 in an FP16 desktop */
+#define HDR_SCRGB_WHITE_NITS 80.0f
+
+#define TONEMAP_LUT_BITS 12
+#define TONEMAP_LUT_SIZE (1 << TONEMAP_LUT_BITS)
+
+/*
+ * Converts linear scRGB FP16 pixels to 8 bit sRGB. Values are scaled so
+ * that the SDR white level maps to 1.0, SDR content keeps its exact levels
+ * and highlights above SDR white clip, 8 bit has no room for them.
+ */
+struct tonemap {
+	float scale;
+	uint8_t lut[TONEMAP_LUT_SIZE];
+};
+
+void tonemap_init(struct tonemap *tonemap, float sdr_white_nits);
+
+/*
+ * Converts width x height R16G16B16A16_FLOAT pixels to 32 bit BGRX.
+ */
+void tonemap_copy(const struct tonemap *tonemap,
+				  const uint8_t *src, int src_stride, int width, int height,
+				  uint8_t *dst, int dst_stride);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,31 @@
+#include "idle.h"
+
+void idle_policy_init(struct idle_policy *idle, int min_ms, int max_ms, int active_ms)
+{
+	idle->min_ms = min_ms;
+	idle->max_ms = max_ms > min_ms ? max_ms : min_ms;
+	idle->active_ms = active_ms;
+	idle->last_activity = 0;
+	idle->timeout_ms = idle->max_ms;
+}
+
+void idle_policy_activity(struct idle_policy *idle, int64_t now)
+{
+	idle->last_activity = now;
+	idle->timeout_ms = idle->min_ms;
+}
+
+int idle_policy_timeout(struct idle_policy *idle, int64_t now)
+{
+	if (now - idle->last_activity < (int64_t) idle->active_ms * 1000)
+		return idle->timeout_ms = idle->min_ms;
+
+	/* back off gradually, short pauses in activity are common */
+	if (idle->timeout_ms < idle->max_ms) {
+		idle->timeout_ms *= 2;
+		if (idle->timeout_ms > idle->max_ms)
+			idle->timeout_ms = idle->max_ms;
+	}
+
+	return idle->timeout_ms;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Timeout for waiting on the next frame. It stays short while frames or
+ * input arrive, so the loop reacts quickly, and doubles up to a long
+ * timeout once the desktop is idle to save wakeups.
+ */
+struct idle_policy {
+	int min_ms;
+	int max_ms;
+	int active_ms;			/* keep min_ms this long after activity */
+	int64_t last_activity;	/* us */
+	int timeout_ms;
+};
+
+void idle_policy_init(struct idle_policy *idle, int min_ms, int max_ms, int active_ms);
+
+/* a frame or input arrived */
+void idle_policy_activity(struct idle_policy *idle, int64_t now);
+
+/* timeout for the next wait */
+int idle_policy_timeout(struct idle_policy *idle, int64_t now);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
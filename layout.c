@@ -0,0 +1,91 @@
+#include <string.h>
+
+#include "layout.h"
+
+static int map_coord(int v, int from_origin, int from_size, int to_origin, int to_size)
+{
+	return to_origin + (int) ((int64_t) (v - from_origin) * to_size / from_size);
+}
+
+/* the last pixel map_coord takes to v, so a point maps back to itself */
+static int unmap_coord(int v, int from_size, int to_origin, int to_size)
+{
+	return to_origin + (int) (((int64_t) (v + 1) * to_size + from_size - 1) / from_size) - 1;
+}
+
+int layout_init(struct layout *layout, const struct layout_output *outputs, int count, int width, int height)
+{
+	int i;
+
+	memset(layout, 0, sizeof(*layout));
+	if (count <= 0 || count > LAYOUT_MAX_OUTPUTS)
+		return -1;
+
+	for (i = 0; i < count; ++i) {
+		if (rect_is_empty(&outputs[i].desktop))
+			return -1;
+		layout->outputs[i] = outputs[i];
+		if (i)
+			rect_union(&layout->desktop, &layout->desktop, &outputs[i].desktop);
+		else
+			layout->desktop = outputs[i].desktop;
+	}
+	layout->count = count;
+	layout->width = width > 0 ? width : rect_width(&layout->desktop);
+	layout->height = height > 0 ? height : rect_height(&layout->desktop);
+
+	/* edges are mapped, not sizes, so adjacent outputs stay adjacent */
+	for (i = 0; i < count; ++i) {
+		const struct rect *d = &layout->outputs[i].desktop;
+		struct rect *s = &layout->outputs[i].surface;
+
+		s->left = d->left;
+		s->top = d->top;
+		s->right = d->right;
+		s->bottom = d->bottom;
+		layout_point_to_surface(layout, &s->left, &s->top);
+		layout_point_to_surface(layout, &s->right, &s->bottom);
+		if (rect_is_empty(s))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int rect_equal(const struct rect *a, const struct rect *b)
+{
+	return a->left == b->left && a->top == b->top && a->right == b->right && a->bottom == b->bottom;
+}
+
+int layout_equal(const struct layout *a, const struct layout *b)
+{
+	int i;
+
+	if (a->count != b->count || a->width != b->width || a->height != b->height)
+		return 0;
+
+	for (i = 0; i < a->count; ++i) {
+		if (a->outputs[i].id != b->outputs[i].id ||
+			!rect_equal(&a->outputs[i].desktop, &b->outputs[i].desktop) ||
+			!rect_equal(&a->outputs[i].surface, &b->outputs[i].surface))
+			return 0;
+	}
+
+	return 1;
+}
+
+void layout_point_to_surface(const struct layout *layout, int *x, int *y)
+{
+	const struct rect *d = &layout->desktop;
+
+	*x = map_coord(*x, d->left, rect_width(d), 0, layout->width);
+	*y = map_coord(*y, d->top, rect_height(d), 0, layout->height);
+}
+
+void layout_point_to_desktop(const struct layout *layout, int *x, int *y)
+{
+	const struct rect *d = &layout->desktop;
+
+	*x = unmap_coord(*x, layout->width, d->left, rect_width(d));
+	*y = unmap_coord(*y, layout->height, d->top, rect_height(d));
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "rect.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define LAYOUT_MAX_OUTPUTS 8
+
+/*
+ * The outputs of the virtual desktop on one primary surface. The surface
+ * covers their bounding box, scaled as a whole, every output becomes a
+ * head on it. Areas of the bounding box no output covers stay black.
+ */
+struct layout_output {
+	int id;					/* DXGI output number */
+	struct rect desktop;	/* virtual desktop coordinates */
+	struct rect surface;	/* area on the primary surface */
+};
+
+struct layout {
+	struct layout_output outputs[LAYOUT_MAX_OUTPUTS];
+	int count;
+	struct rect desktop;	/* bounding box */
+	int width;				/* primary surface */
+	int height;
+};
+
+/*
+ * Places count outputs, id and desktop set, on a surface of width x height,
+ * 0 for the size of the bounding box.
+ */
+int layout_init(struct layout *layout, const struct layout_output *outputs, int count, int width, int height);
+
+/* non-zero if both place the same outputs at the same surface areas */
+int layout_equal(const struct layout *a, const struct layout *b);
+
+/*
+ * Map points between the virtual desktop and the surface. A surface point
+ * maps to a desktop pixel shown there and back to itself.
+ */
+void layout_point_to_surface(const struct layout *layout, int *x, int *y);
+void layout_point_to_desktop(const struct layout *layout, int *x, int *y);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -6,13 +6,81 @@
 #include <stdbool.h>
 #include <ws2tcpip.h>
 
+#include "client.h"
+#include "compress.h"
 #include "display.h"
 
 GMutex lock;
 int draw_command_in_progress;
 
-GAsyncQueue *cursor_queue;
-GAsyncQueue *draw_queue;
+struct cursor_channel cursor_channel;
+struct scheduler draw_queue;
+struct shadow shadow;
+struct mem_budget draw_budget;
+struct work_pool workers;
+
+static struct display_config display_config;
+static SpiceServer *spice_server;
+
+/* video codecs spice may encode with and whether the client decodes LZ4 */
+static unsigned int server_codecs;
+static gint client_lz4;
+
+static gchar *opt_scale = NULL;
+static gchar *opt_scale_filter = NULL;
+static gboolean opt_hdr = FALSE;
+static gdouble opt_sdr_white = HDR_SCRGB_WHITE_NITS;
+static gboolean opt_split_content = FALSE;
+static gint opt_max_drawable_size = 0;
+static gboolean opt_fifo = FALSE;
+static gint opt_metrics = 0;
+static gint opt_memory_budget = 256;
+static gint opt_max_fps = 0;
+static gint opt_max_bandwidth = 0;
+static gboolean opt_adaptive_compression = FALSE;
+static gchar *opt_streaming = NULL;
+static gchar *opt_video_codecs = NULL;
+static gint opt_refresh = 0;
+static gint opt_workers = 0;
+static gboolean opt_lz4 = FALSE;
+
+static GOptionEntry option_entries[] = {
+	{ "scale", 's', 0, G_OPTION_ARG_STRING, &opt_scale,
+	  "Scale the desktop to the given size before sending it", "WIDTHxHEIGHT" },
+	{ "scale-filter", 0, 0, G_OPTION_ARG_STRING, &opt_scale_filter,
+	  "Filter used for scaling, box (default) or bilinear", "FILTER" },
+	{ "hdr", 0, 0, G_OPTION_ARG_NONE, &opt_hdr,
+	  "Capture HDR desktops in FP16 and tone map them", NULL },
+	{ "sdr-white", 0, 0, G_OPTION_ARG_DOUBLE, &opt_sdr_white,
+	  "SDR white level of the HDR desktop in nits (default 80)", "NITS" },
+	{ "split-content", 0, 0, G_OPTION_ARG_NONE, &opt_split_content,
+	  "Send text and image content of an update as separate images", NULL },
+	{ "max-drawable-size", 0, 0, G_OPTION_ARG_INT, &opt_max_drawable_size,
+	  "Send larger updates as tiles of at most this size", "KB" },
+	{ "fifo", 0, 0, G_OPTION_ARG_NONE, &opt_fifo,
+	  "Send updates in capture order instead of prioritizing updates near the pointer", NULL },
+	{ "max-fps", 0, 0, G_OPTION_ARG_INT, &opt_max_fps,
+	  "Send at most this many updates per second, damage in between is merged", "FPS" },
+	{ "max-bandwidth", 0, 0, G_OPTION_ARG_INT, &opt_max_bandwidth,
+	  "Pace updates to about this many compressed kilobytes per second", "KBPS" },
+	{ "adaptive-compression", 0, 0, G_OPTION_ARG_NONE, &opt_adaptive_compression,
+	  "Switch to lossy compression while updates back up", NULL },
+	{ "lz4", 0, 0, G_OPTION_ARG_NONE, &opt_lz4,
+	  "Compress lossless images with LZ4 for clients that support it", NULL },
+	{ "streaming", 0, 0, G_OPTION_ARG_STRING, &opt_streaming,
+	  "Video streaming: off, all or filter (spice's default)", "MODE" },
+	{ "video-codecs", 0, 0, G_OPTION_ARG_STRING, &opt_video_codecs,
+	  "Video codecs in order of preference, e.g. gstreamer:h264;gstreamer:vp8;spice:mjpeg", "CODECS" },
+	{ "refresh", 0, 0, G_OPTION_ARG_INT, &opt_refresh,
+	  "Compare the whole screen with what was sent once per SECONDS and resend what differs", "SECONDS" },
+	{ "workers", 0, 0, G_OPTION_ARG_INT, &opt_workers,
+	  "Scale and prepare updates on this many threads", "N" },
+	{ "memory-budget", 0, 0, G_OPTION_ARG_INT, &opt_memory_budget,
+	  "Pause capture while unsent updates hold more than this memory, 0 for unlimited (default 256)", "MB" },
+	{ "metrics", 0, 0, G_OPTION_ARG_INT, &opt_metrics,
+	  "Print metrics every SECONDS seconds", "SECONDS" },
+	{ NULL }
+};
 
 struct SpiceTimer {
 	SpiceTimerFunc func;
@@ -167,6 +235,18 @@ static void channel_event(int event, SpiceChannelEventInfo *info)
 
 	if (event == SPICE_CHANNEL_EVENT_DISCONNECTED && info->type == SPICE_CHANNEL_MAIN)
 		printf("disconnect\n");
+
+	/* every main channel connection is one client */
+	if (info->type == SPICE_CHANNEL_MAIN) {
+		if (event == SPICE_CHANNEL_EVENT_CONNECTED)
+			display_client_connected(&display_config);
+		else if (event == SPICE_CHANNEL_EVENT_DISCONNECTED)
+			display_client_disconnected(&display_config);
+	}
+
+	/* the surface memory is not sent, the new client gets a full frame instead */
+	if (event == SPICE_CHANNEL_EVENT_INITIALIZED && info->type == SPICE_CHANNEL_DISPLAY)
+		display_bootstrap(&display_config);
 }
 
 SpiceCoreInterface core = {
@@ -191,6 +271,8 @@ static void kbd_push_key(SpiceKbdInstance *sin, uint8_t frag)
 		| (is_extendedkey ? KEYEVENTF_EXTENDEDKEY : 0)
 		| ((frag & 0x80) ? KEYEVENTF_KEYUP : 0);
 
+	display_input(&display_config);
+
 	if (frag ==224) {
 		is_extendedkey = true;
 		return;
@@ -263,6 +345,17 @@ void tablet_buttons(SpiceTabletInstance *tablet, uint32_t buttons_state)
 
 void tablet_position(SpiceTabletInstance *tablet, int x, int y, uint32_t buttons_state)
 {
+	display_input(&display_config);
+
+	g_mutex_lock(&lock);
+	scheduler_set_focus(&draw_queue, x, y);
+	g_mutex_unlock(&lock);
+
+	/* the client sends positions on the scaled surface */
+	g_mutex_lock(&display_config.layout_lock);
+	layout_point_to_desktop(&display_config.layout, &x, &y);
+	g_mutex_unlock(&display_config.layout_lock);
+
 	SetCursorPos(x, y);
 
 	tablet_buttons(tablet, buttons_state);
@@ -270,6 +363,7 @@ void tablet_position(SpiceTabletInstance *tablet, int x, int y, uint32_t buttons
 
 void tablet_wheel(SpiceTabletInstance *tablet, int wheel_motion, uint32_t buttons_state)
 {
+	display_input(&display_config);
 	tablet_buttons(tablet, buttons_state);
 }
 
@@ -310,15 +404,43 @@ static void attach_worker(QXLInstance *qin, QXLWorker *qxl_worker G_GNUC_UNUSED)
 	spice_qxl_add_memslot(qin, &slot);
 }
 
-static void set_compression_level(QXLInstance *qin, int level)
+/*
+ * Spice reports whether the device should compress by itself, 1 only for
+ * QUIC without video streaming. kuemmel leaves compression to spice, the
+ * level only shows that a compression change took effect.
+ */
+static void set_compression_level(QXLInstance *qin G_GNUC_UNUSED, int level)
+{
+	metrics_set(METRIC_COMPRESSION_LEVEL, level);
+}
+
+/* sent when spice adjusts its clock, e.g. for the client latency */
+static void set_mm_time(QXLInstance *qin G_GNUC_UNUSED, uint32_t mm_time)
 {
-	// TODO - set_compression_level is unused
+	display_set_mm_time(&display_config, mm_time);
 }
 
-/* Newer spice servers no longer transmit this information,
-	so let's just disregard it */
-static void set_mm_time(QXLInstance *qin G_GNUC_UNUSED, uint32_t mm_time G_GNUC_UNUSED)
+static gboolean update_client_compression(gpointer user_data);
+
+/*
+ * Called from the spice worker when the first display client connects or
+ * the last one leaves. The client decides whether holding frames back for
+ * the stream detector is worth it and whether LZ4 is used.
+ */
+static void set_client_capabilities(QXLInstance *qin G_GNUC_UNUSED, uint8_t client_present,
+									uint8_t caps[SPICE_CAPABILITIES_SIZE])
 {
+	struct client_caps client;
+
+	client_caps_parse(&client, client_present, caps);
+	if (client.present)
+		printf("client decodes codecs 0x%x, lz4 %d, monitors config %d\n",
+			   client.codecs, client.lz4, client.monitors_config);
+
+	g_atomic_int_set(&display_config.client_streams, client_can_stream(&client, server_codecs));
+	g_atomic_int_set(&client_lz4, client.lz4);
+	if (opt_lz4)
+		g_idle_add(update_client_compression, NULL);
 }
 
 static void get_init_info(QXLInstance *qin G_GNUC_UNUSED, QXLDevInitInfo *info)
@@ -337,17 +459,21 @@ static void get_init_info(QXLInstance *qin G_GNUC_UNUSED, QXLDevInitInfo *info)
 static int get_command(QXLInstance *qin, struct QXLCommandExt *cmd)
 {
 	QXLDrawable *drawable;
+	int64_t waited;
 
 	if (!g_mutex_trylock(&lock))
 		return 0;
 
-	drawable = g_async_queue_try_pop(draw_queue);
+	drawable = scheduler_pop(&draw_queue, g_get_monotonic_time(), &waited);
 	draw_command_in_progress = (drawable != NULL);
 	g_mutex_unlock(&lock);
 
 	if (!drawable)
 		return 0;
 
+	metrics_add(METRIC_DRAWABLES_SENT, 1);
+	metrics_add(METRIC_QUEUE_WAIT_US, waited);
+
 	cmd->group_id = 0;
 	cmd->flags = 0;
 	cmd->cmd.type = QXL_CMD_DRAW;
@@ -364,26 +490,21 @@ static int req_cmd_notification(QXLInstance *qin)
 	if (!g_mutex_trylock(&lock))
 		return ret;
 
-	ret = (g_async_queue_length(draw_queue)) > 0 ? 0 : 1;
+	ret = scheduler_length(&draw_queue) > 0 ? 0 : 1;
 	g_mutex_unlock(&lock);
 	return (ret);
 }
 
 static void release_resource(QXLInstance *qin G_GNUC_UNUSED, struct QXLReleaseInfoExt release_info)
 {
-	release_asset(release_info.info);
+	release_asset((void *) (uintptr_t) release_info.info->id);
 }
 
 static int get_cursor_command(QXLInstance *qin, struct QXLCommandExt *cmd)
 {
 	QXLCursorCmd *cursor_cmd;
 
-	if (!g_mutex_trylock(&lock))
-		return 0;
-
-	cursor_cmd = g_async_queue_try_pop(cursor_queue);
-	draw_command_in_progress = (cursor_cmd != NULL);
-	g_mutex_unlock(&lock);
+	cursor_cmd = cursor_channel_pop(&cursor_channel);
 
 	if (!cursor_cmd)
 		return 0;
@@ -399,32 +520,48 @@ static int get_cursor_command(QXLInstance *qin, struct QXLCommandExt *cmd)
 
 static int req_cursor_notification(QXLInstance *qin)
 {
-	return (g_async_queue_length(cursor_queue) > 0) ? 0 : 1;
+	return cursor_channel_pending(&cursor_channel) ? 0 : 1;
 }
 
-static void notify_update(QXLInstance *qin G_GNUC_UNUSED, uint32_t update_id G_GNUC_UNUSED)
+/* only sent for QXL_CMD_UPDATE, kuemmel writes the surface memory directly */
+static void notify_update(QXLInstance *qin G_GNUC_UNUSED, uint32_t update_id)
 {
-	g_debug("TODO: %s UNIMPLEMENTED", __func__);
+	g_debug("%s: update %u", __func__, update_id);
 }
 
+/*
+ * Called when spice runs low on memory or capture asked it to with
+ * spice_qxl_oom(). Resources are released synchronously, so there is
+ * nothing to push back. Returning 0, nothing was released since the last
+ * call, makes spice drop drawables of slow clients.
+ */
 static int flush_resources(QXLInstance *qin G_GNUC_UNUSED)
 {
-	g_debug("TODO: %s UNIMPLEMENTEDs", __func__);
-	// Return 0 to direct the server to flush resources
-	return 1;
+	return mem_budget_flush(&draw_budget);
 }
 
+/* the cookie of an async call points to an asset owning its arguments */
 static void async_complete(QXLInstance *qin G_GNUC_UNUSED, uint64_t cookie)
 {
-	g_debug("TODO: %s UNIMPLEMENTED!", __func__);
+	if (cookie)
+		release_asset((void *) (uintptr_t) cookie);
 }
 
+/*
+ * Spice rendered the pending drawables of these areas into the surface
+ * memory, which is the shadow framebuffer.
+ */
 static void update_area_complete(QXLInstance *qin G_GNUC_UNUSED,
-								 uint32_t surface_id G_GNUC_UNUSED,
-								 struct QXLRect *updated_rects G_GNUC_UNUSED,
-								 uint32_t num_updated_rects G_GNUC_UNUSED)
+								 uint32_t surface_id,
+								 struct QXLRect *updated_rects,
+								 uint32_t num_updated_rects)
 {
-	g_debug("TODO: %s UNIMPLEMENTED!", __func__);
+	uint32_t i;
+
+	for (i = 0; i < num_updated_rects; ++i)
+		g_debug("%s: surface %u (%d,%d)-(%d,%d)", __func__, surface_id,
+				updated_rects[i].left, updated_rects[i].top,
+				updated_rects[i].right, updated_rects[i].bottom);
 }
 
 static const QXLInterface display_sif = {
@@ -451,39 +588,71 @@ static const QXLInterface display_sif = {
 	.client_monitors_config = NULL, /* Specifying NULL here causes
 										the better logic in the agent
 										to operate */
-	.set_client_capabilities = NULL,    /* Allowed to be unset */
+	.set_client_capabilities = set_client_capabilities,
 };
 
 static QXLInstance display_sin = {
 	.base.sif = &display_sif.base,
 };
 
-static int send_monitors_config(int w, int h)
+static void async_asset_release(struct asset *asset)
 {
-	QXLMonitorsConfig *monitors = calloc(1, sizeof(QXLMonitorsConfig) + sizeof(QXLHead));
+	free(asset);
+}
+
+/* size bytes of zeroed memory that stays valid until the async call completes */
+static void *async_asset_new(size_t size, struct asset **asset)
+{
+	*asset = calloc(1, sizeof(**asset) + size);
+	if (!*asset)
+		return NULL;
+
+	(*asset)->release = async_asset_release;
+
+	return *asset + 1;
+}
+
+/* every output is a head on the primary surface */
+static int send_monitors_config(const struct layout *layout)
+{
+	struct asset *asset;
+	QXLMonitorsConfig *monitors = async_asset_new(sizeof(QXLMonitorsConfig) + layout->count * sizeof(QXLHead),
+												  &asset);
+	int i;
+
 	if (!monitors)
 		return -ENOMEM;
 
-	monitors->count = 1;
-	monitors->max_allowed = 1;
-	monitors->heads[0].id = 0;
-	monitors->heads[0].surface_id = 0;
-	monitors->heads[0].width = w;
-	monitors->heads[0].height = h;
+	monitors->count = layout->count;
+	monitors->max_allowed = layout->count;
+	for (i = 0; i < layout->count; ++i) {
+		const struct rect *r = &layout->outputs[i].surface;
+
+		monitors->heads[i].id = i;
+		monitors->heads[i].surface_id = 0;
+		monitors->heads[i].x = r->left;
+		monitors->heads[i].y = r->top;
+		monitors->heads[i].width = rect_width(r);
+		monitors->heads[i].height = rect_height(r);
+	}
 
-	spice_qxl_monitors_config_async(&display_sin, (uintptr_t) monitors, 0, 0);
+	spice_qxl_monitors_config_async(&display_sin, (uintptr_t) monitors, 0, (uintptr_t) asset);
 
 	return 0;
 }
 
-int spice_create_primary(int w, int h, int bytes_per_line, void *shmaddr)
+/*
+ * The surface memory is the shadow framebuffer, top down. Spice reads it
+ * directly and renders drawables into it for its own update_area.
+ */
+int spice_create_primary(int w, int h, int bytes_per_line, void *mem)
 {
 	QXLDevSurfaceCreate surface = { };
 
 	surface.height = h;
 	surface.width = w;
 
-	surface.stride = -1 * bytes_per_line;
+	surface.stride = bytes_per_line;
 	surface.type = QXL_SURF_TYPE_PRIMARY;
 	surface.flags = 0;
 	surface.group_id = 0;
@@ -494,11 +663,11 @@ int spice_create_primary(int w, int h, int bytes_per_line, void *shmaddr)
 
 	/* TODO - compute this dynamically */
 	surface.format = SPICE_SURFACE_FMT_32_xRGB;
-	surface.mem = (uintptr_t) malloc(h*bytes_per_line);
+	surface.mem = (uintptr_t) mem;
 
 	spice_qxl_create_primary_surface(&display_sin, 0, &surface);
 
-	return send_monitors_config(w, h);
+	return send_monitors_config(&display_config.layout);
 }
 
 void spice_destroy_primary()
@@ -506,13 +675,251 @@ void spice_destroy_primary()
 	spice_qxl_destroy_primary_surface(&display_sin, 0);
 }
 
+struct resize_request {
+	struct display_config *cfg;
+	const struct layout *layout;
+	GMutex lock;
+	GCond cond;
+	int done;
+};
+
+/*
+ * Runs on the spice main loop, which also calls the input callbacks that
+ * map pointer positions with the layout and handles new clients.
+ */
+static gboolean apply_resize(gpointer user_data)
+{
+	struct resize_request *request = user_data;
+	struct display_config *cfg = request->cfg;
+
+	g_mutex_lock(&cfg->layout_lock);
+	cfg->layout = *request->layout;
+	g_mutex_unlock(&cfg->layout_lock);
+
+	spice_destroy_primary();
+	if (shadow_resize(cfg->shadow, cfg->layout.width, cfg->layout.height) < 0) {
+		fprintf(stderr, "failed to resize the primary surface to %dx%d\n",
+				cfg->layout.width, cfg->layout.height);
+		exit(EXIT_FAILURE);
+	}
+	spice_create_primary(cfg->shadow->width, cfg->shadow->height, cfg->shadow->stride, cfg->shadow->pixels);
+
+	g_mutex_lock(&request->lock);
+	request->done = 1;
+	g_cond_signal(&request->cond);
+	g_mutex_unlock(&request->lock);
+
+	return FALSE;
+}
+
+/* called by the display supervisor once no capture thread runs */
+static void resize_primary(struct display_config *cfg, const struct layout *layout)
+{
+	struct resize_request request = { cfg, layout };
+
+	g_mutex_init(&request.lock);
+	g_cond_init(&request.cond);
+	g_idle_add(apply_resize, &request);
+
+	g_mutex_lock(&request.lock);
+	while (!request.done)
+		g_cond_wait(&request.cond, &request.lock);
+	g_mutex_unlock(&request.lock);
+
+	g_mutex_clear(&request.lock);
+	g_cond_clear(&request.cond);
+}
+
+static gboolean print_metrics(gpointer user_data G_GNUC_UNUSED)
+{
+	static int64_t last_wakeups, last_frames;
+	int64_t wakeups = metrics_get(METRIC_WAKEUPS);
+	int64_t frames = metrics_get(METRIC_FRAMES_SENT);
+	FILETIME creation, exited, kernel, user;
+
+	metrics_set(METRIC_WAKEUPS_PER_SEC, (wakeups - last_wakeups) / opt_metrics);
+	metrics_set(METRIC_FPS, (frames - last_frames) / opt_metrics);
+	last_wakeups = wakeups;
+	last_frames = frames;
+
+	/* 100 ns units */
+	if (GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user)) {
+		uint64_t cpu = ((uint64_t) kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+					   ((uint64_t) user.dwHighDateTime << 32 | user.dwLowDateTime);
+		metrics_set(METRIC_CPU_MS, cpu / 10000);
+	}
+
+	metrics_print(stdout);
+
+	return TRUE;
+}
+
+static int streaming_parse(const char *name, int *mode)
+{
+	if (!strcmp(name, "off"))
+		*mode = SPICE_STREAM_VIDEO_OFF;
+	else if (!strcmp(name, "all"))
+		*mode = SPICE_STREAM_VIDEO_ALL;
+	else if (!strcmp(name, "filter"))
+		*mode = SPICE_STREAM_VIDEO_FILTER;
+	else
+		return -1;
+
+	return 0;
+}
+
+static struct compress_ctl compress_ctl;
+
+static void compress_sample(struct compress_sample *sample)
+{
+	sample->now = g_get_monotonic_time();
+	sample->sent = metrics_get(METRIC_DRAWABLES_SENT);
+	sample->waited = metrics_get(METRIC_QUEUE_WAIT_US);
+	sample->released_bytes = metrics_get(METRIC_RELEASED_BYTES);
+
+	g_mutex_lock(&lock);
+	sample->oldest = scheduler_oldest(&draw_queue, sample->now);
+	g_mutex_unlock(&lock);
+}
+
+/*
+ * Lossy mode lets spice use JPEG for photo like images, lossless mode
+ * keeps GLZ for everything. Only the image compression can be changed at
+ * runtime, JPEG is allowed once at startup. Without adaptive compression
+ * lossless mode is spice's default, GLZ with QUIC for photos.
+ */
+static void set_compression_mode(SpiceServer *server, enum compress_mode mode)
+{
+	SpiceImageCompression lossless = opt_adaptive_compression ?
+		SPICE_IMAGE_COMPRESSION_GLZ : SPICE_IMAGE_COMPRESSION_AUTO_GLZ;
+
+	/* LZ4 trades ratio for decode speed, only for clients that have it */
+	if (opt_lz4 && g_atomic_int_get(&client_lz4))
+		lossless = SPICE_IMAGE_COMPRESSION_LZ4;
+
+	spice_server_set_image_compression(server, mode == COMPRESS_LOSSY ?
+									   SPICE_IMAGE_COMPRESSION_AUTO_GLZ : lossless);
+	metrics_set(METRIC_LOSSY, mode == COMPRESS_LOSSY);
+	g_atomic_int_set(&display_config.lossy, mode == COMPRESS_LOSSY);
+}
+
+static gboolean update_client_compression(gpointer user_data G_GNUC_UNUSED)
+{
+	set_compression_mode(spice_server, compress_ctl.mode);
+
+	return FALSE;
+}
+
+static gboolean update_compression(gpointer user_data)
+{
+	SpiceServer *server = user_data;
+	struct compress_sample sample;
+
+	compress_sample(&sample);
+	if (compress_ctl_update(&compress_ctl, &sample)) {
+		printf("switching to %s compression, queue latency %.0f ms\n",
+			   compress_ctl.mode == COMPRESS_LOSSY ? "lossy" : "lossless", compress_ctl.latency_ms);
+		set_compression_mode(server, compress_ctl.mode);
+	}
+
+	metrics_set(METRIC_QUEUE_LATENCY_MS, (int64_t) compress_ctl.latency_ms);
+	metrics_set(METRIC_DRAIN_RATE, (int64_t) compress_ctl.drain_rate);
+	metrics_set(METRIC_BANDWIDTH, (int64_t) compress_ctl.bandwidth);
+
+	return TRUE;
+}
+
 int main(int argc, char** argv)
 {
-	draw_queue = g_async_queue_new();
-	cursor_queue = g_async_queue_new();
+	GError *error = NULL;
+	GOptionContext *context = g_option_context_new("- spice server for the windows desktop");
+	int scale_width = 0, scale_height = 0;
+	enum scale_filter scale_filter = SCALE_FILTER_BOX;
+	int streaming = SPICE_STREAM_VIDEO_FILTER;
+
+	g_option_context_add_main_entries(context, option_entries, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		exit(EXIT_FAILURE);
+	}
+	g_option_context_free(context);
+
+	if (opt_scale && (sscanf(opt_scale, "%dx%d", &scale_width, &scale_height) != 2 ||
+					  scale_width <= 0 || scale_height <= 0)) {
+		fprintf(stderr, "invalid scale %s\n", opt_scale);
+		exit(EXIT_FAILURE);
+	}
+
+	if (opt_scale_filter && scale_filter_parse(opt_scale_filter, &scale_filter) < 0) {
+		fprintf(stderr, "invalid scale filter %s\n", opt_scale_filter);
+		exit(EXIT_FAILURE);
+	}
+
+	display_config.scale_width = scale_width;
+	display_config.scale_height = scale_height;
+	display_config.scale_filter = scale_filter;
+	if (display_layout(&display_config, &display_config.layout) < 0) {
+		fprintf(stderr, "no output to capture\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (opt_streaming && streaming_parse(opt_streaming, &streaming) < 0) {
+		fprintf(stderr, "invalid streaming mode %s\n", opt_streaming);
+		exit(EXIT_FAILURE);
+	}
+
+	if (opt_sdr_white <= 0) {
+		fprintf(stderr, "invalid SDR white level %g\n", opt_sdr_white);
+		exit(EXIT_FAILURE);
+	}
+
+	display_config.hdr = opt_hdr;
+	display_config.split_content = opt_split_content;
+	display_config.max_drawable_size = opt_max_drawable_size > 0 ? opt_max_drawable_size * 1024 : 0;
+	display_config.max_fps = opt_max_fps > 0 ? opt_max_fps : 0;
+	/* the stream detector needs frames at a steady rate and a stable bounding box */
+	if (opt_streaming && streaming != SPICE_STREAM_VIDEO_OFF) {
+		if (!display_config.max_fps)
+			display_config.stream_fps = 30;
+		display_config.track_video = 1;
+	}
+	/* until the first client tells otherwise */
+	display_config.client_streams = 1;
+	server_codecs = client_codecs_parse(opt_video_codecs);
+	display_config.max_bandwidth = opt_max_bandwidth > 0 ? (int64_t) opt_max_bandwidth * 1024 : 0;
+	display_config.refresh_period = opt_refresh > 0 ? opt_refresh : 0;
+	tonemap_init(&display_config.tonemap, opt_sdr_white);
+
+	if (scheduler_init(&draw_queue) < 0)
+		exit(EXIT_FAILURE);
+	draw_queue.fifo = opt_fifo;
+	cursor_channel_init(&cursor_channel);
+	if (opt_memory_budget < 0) {
+		fprintf(stderr, "invalid memory budget %d\n", opt_memory_budget);
+		exit(EXIT_FAILURE);
+	}
+	mem_budget_init(&draw_budget, (size_t) opt_memory_budget * 1024 * 1024);
+	if (shadow_init(&shadow, display_config.layout.width, display_config.layout.height) < 0)
+		exit(EXIT_FAILURE);
 	g_mutex_init(&lock);
 
-	struct display_config display_config = { &display_sin, draw_queue, cursor_queue };
+	if (opt_workers > 0) {
+		if (work_pool_init(&workers, opt_workers) < 0)
+			exit(EXIT_FAILURE);
+		display_config.pool = &workers;
+	}
+
+	display_config.display_sin = &display_sin;
+	display_config.draw_lock = &lock;
+	display_config.draw_queue = &draw_queue;
+	display_config.cursor = &cursor_channel;
+	display_config.shadow = &shadow;
+	display_config.budget = &draw_budget;
+	display_config.resize = resize_primary;
+	g_mutex_init(&display_config.layout_lock);
+	g_mutex_init(&display_config.client_lock);
+	g_mutex_init(&display_config.mm_lock);
+	g_cond_init(&display_config.client_cond);
 
 	printf("v %d\n", spice_get_current_compat_version());
 	SpiceServer *server = spice_server_new();
@@ -520,10 +927,29 @@ int main(int argc, char** argv)
 		exit(EXIT_FAILURE);
 	printf("server %p\n", server);
 
+	spice_server = server;
 	spice_server_set_port(server, 19191);
 	spice_server_set_noauth(server);
 	spice_server_set_name(server, "kuemmel");
 
+	if (opt_streaming)
+		spice_server_set_streaming_video(server, streaming);
+	if (opt_video_codecs && spice_server_set_video_codecs(server, opt_video_codecs) < 0) {
+		fprintf(stderr, "invalid video codecs %s\n", opt_video_codecs);
+		spice_server_destroy(server);
+		exit(EXIT_FAILURE);
+	}
+
+	if (opt_adaptive_compression) {
+		struct compress_sample sample;
+
+		spice_server_set_jpeg_compression(server, SPICE_WAN_COMPRESSION_ALWAYS);
+		spice_server_set_zlib_glz_compression(server, SPICE_WAN_COMPRESSION_AUTO);
+		compress_sample(&sample);
+		compress_ctl_init(&compress_ctl, &sample);
+		set_compression_mode(server, compress_ctl.mode);
+	}
+
 	if (spice_server_init(server, &core) < 0) {
 		spice_server_destroy(server);
 		exit(EXIT_FAILURE);
@@ -546,9 +972,14 @@ int main(int argc, char** argv)
 
 	spice_server_vm_start(server);
 
-	spice_create_primary(1920, 1080, 1920*4, NULL);
+	spice_create_primary(shadow.width, shadow.height, shadow.stride, shadow.pixels);
+
+	display_start(&display_config);
 
-	g_thread_new("display", display, &display_config);
+	if (opt_metrics > 0)
+		g_timeout_add_seconds(opt_metrics, print_metrics, NULL);
+	if (opt_adaptive_compression)
+		g_timeout_add_seconds(1, update_compression, server);
 
 	GMainLoop *loop = g_main_loop_new (NULL, FALSE);
 
@@ -0,0 +1,82 @@
+#include <glib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+static const char *const metric_names[METRIC_COUNT] = {
+	[METRIC_BOOTSTRAPS] = "bootstraps",
+	[METRIC_FIRST_FRAME_MS] = "first_frame_ms",
+	[METRIC_INFLIGHT_BYTES] = "inflight_bytes",
+	[METRIC_OOM] = "oom",
+	[METRIC_THROTTLED_MS] = "throttled_ms",
+	[METRIC_CAPTURING] = "capturing",
+	[METRIC_PAUSED_MS] = "paused_ms",
+	[METRIC_CPU_MS] = "cpu_ms",
+	[METRIC_WAKEUPS] = "wakeups",
+	[METRIC_WAKEUPS_PER_SEC] = "wakeups_per_sec",
+	[METRIC_FRAMES_SENT] = "frames_sent",
+	[METRIC_ACCUMULATED_FRAMES] = "accumulated_frames",
+	[METRIC_FPS] = "fps",
+	[METRIC_ESTIMATED_BYTES] = "estimated_bytes",
+	[METRIC_DRAWABLES_SENT] = "drawables_sent",
+	[METRIC_QUEUE_WAIT_US] = "queue_wait_us",
+	[METRIC_RELEASED_BYTES] = "released_bytes",
+	[METRIC_QUEUE_LATENCY_MS] = "queue_latency_ms",
+	[METRIC_DRAIN_RATE] = "drain_rate",
+	[METRIC_BANDWIDTH] = "bandwidth",
+	[METRIC_LOSSY] = "lossy",
+	[METRIC_COMPRESSION_LEVEL] = "compression_level",
+	[METRIC_REFINE_BYTES] = "refine_bytes",
+	[METRIC_REFRESH_BYTES] = "refresh_bytes",
+	[METRIC_REFRESH_TILES] = "refresh_tiles",
+	[METRIC_WORKER_US] = "worker_us",
+	[METRIC_RESTARTS] = "restarts",
+	[METRIC_RESIZES] = "resizes",
+	[METRIC_TRANSITION_MS] = "transition_ms",
+	[METRIC_RECOVERY_FAILURES] = "recovery_failures",
+	[METRIC_BACKOFF_MS] = "backoff_ms",
+};
+
+static GMutex metrics_lock;
+static int64_t metrics[METRIC_COUNT];
+
+void metrics_add(enum metric metric, int64_t value)
+{
+	g_mutex_lock(&metrics_lock);
+	metrics[metric] += value;
+	g_mutex_unlock(&metrics_lock);
+}
+
+void metrics_set(enum metric metric, int64_t value)
+{
+	g_mutex_lock(&metrics_lock);
+	metrics[metric] = value;
+	g_mutex_unlock(&metrics_lock);
+}
+
+int64_t metrics_get(enum metric metric)
+{
+	int64_t value;
+
+	g_mutex_lock(&metrics_lock);
+	value = metrics[metric];
+	g_mutex_unlock(&metrics_lock);
+
+	return value;
+}
+
+void metrics_print(FILE *file)
+{
+	int64_t values[METRIC_COUNT];
+	int i;
+
+	g_mutex_lock(&metrics_lock);
+	memcpy(values, metrics, sizeof(values));
+	g_mutex_unlock(&metrics_lock);
+
+	fprintf(file, "metrics");
+	for (i = 0; i < METRIC_COUNT; ++i)
+		fprintf(file, " %s=%" G_GINT64_FORMAT, metric_names[i], (gint64) values[i]);
+	fprintf(file, "\n");
+	fflush(file);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Process wide counters and gauges, updated from any thread and printed
+ * periodically with --metrics.
+ */
+enum metric {
+	METRIC_BOOTSTRAPS,			/* full frames sent to new clients */
+	METRIC_FIRST_FRAME_MS,		/* connect until the last tile of the full frame was sent */
+	METRIC_INFLIGHT_BYTES,		/* pixel memory of commands not yet released by spice */
+	METRIC_OOM,					/* times spice was asked to free resources */
+	METRIC_THROTTLED_MS,		/* capture paused for memory */
+	METRIC_CAPTURING,			/* 1 while a client is connected */
+	METRIC_PAUSED_MS,			/* capture paused without clients */
+	METRIC_CPU_MS,				/* process CPU time, user and kernel */
+	METRIC_WAKEUPS,				/* returns from AcquireNextFrame */
+	METRIC_WAKEUPS_PER_SEC,		/* over the last --metrics interval */
+	METRIC_FRAMES_SENT,			/* sends of accumulated damage */
+	METRIC_ACCUMULATED_FRAMES,	/* frames merged into a later send by --max-fps */
+	METRIC_FPS,					/* frames sent per second over the last --metrics interval */
+	METRIC_ESTIMATED_BYTES,		/* compressed size estimate of the sent damage */
+	METRIC_DRAWABLES_SENT,		/* drawables handed to spice */
+	METRIC_QUEUE_WAIT_US,		/* time these drawables spent queued */
+	METRIC_RELEASED_BYTES,		/* raw bytes of drawables released by spice */
+	METRIC_QUEUE_LATENCY_MS,	/* smoothed average queue wait */
+	METRIC_DRAIN_RATE,			/* drawables per second */
+	METRIC_BANDWIDTH,			/* raw bytes per second released by spice */
+	METRIC_LOSSY,				/* 1 while --adaptive-compression picked lossy */
+	METRIC_COMPRESSION_LEVEL,	/* as reported by spice through set_compression_level */
+	METRIC_REFINE_BYTES,		/* raw bytes resent losslessly after lossy updates */
+	METRIC_REFRESH_BYTES,		/* raw bytes of tiles corrected by the rolling refresh */
+	METRIC_REFRESH_TILES,
+	METRIC_WORKER_US,			/* time spent in worker jobs, summed over threads */
+	METRIC_RESTARTS,			/* duplications set up again after being lost */
+	METRIC_RESIZES,				/* primary surface re-created for a new layout */
+	METRIC_TRANSITION_MS,		/* from losing a duplication to capturing again, last restart */
+	METRIC_RECOVERY_FAILURES,	/* restarts that had to wait for the backoff */
+	METRIC_BACKOFF_MS,			/* last backoff before a restart */
+	METRIC_COUNT
+};
+
+void metrics_add(enum metric metric, int64_t value);
+void metrics_set(enum metric metric, int64_t value);
+int64_t metrics_get(enum metric metric);
+void metrics_print(FILE *file);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
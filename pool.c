@@ -0,0 +1,72 @@
+#include <glib.h>
+#include <stdio.h>
+
+#include "metrics.h"
+#include "pool.h"
+
+static void work_pool_thread(gpointer data, gpointer user_data G_GNUC_UNUSED)
+{
+	struct work *work = data;
+	struct work_group *group = work->group;
+	gint64 start = g_get_monotonic_time();
+
+	/* work may be freed once the group is done, group outlives it */
+	work->run(work);
+	metrics_add(METRIC_WORKER_US, g_get_monotonic_time() - start);
+
+	g_mutex_lock(&group->lock);
+	if (--group->pending == 0)
+		g_cond_broadcast(&group->done);
+	g_mutex_unlock(&group->lock);
+}
+
+int work_pool_init(struct work_pool *pool, int threads)
+{
+	GError *error = NULL;
+
+	pool->threads = g_thread_pool_new(work_pool_thread, NULL, threads, TRUE, &error);
+	if (!pool->threads) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return -1;
+	}
+
+	return 0;
+}
+
+void work_pool_cleanup(struct work_pool *pool)
+{
+	g_thread_pool_free(pool->threads, FALSE, TRUE);
+}
+
+void work_group_init(struct work_group *group)
+{
+	g_mutex_init(&group->lock);
+	g_cond_init(&group->done);
+	group->pending = 0;
+}
+
+void work_group_clear(struct work_group *group)
+{
+	g_mutex_clear(&group->lock);
+	g_cond_clear(&group->done);
+}
+
+void work_pool_push(struct work_pool *pool, struct work_group *group, struct work *work)
+{
+	work->group = group;
+
+	g_mutex_lock(&group->lock);
+	group->pending++;
+	g_mutex_unlock(&group->lock);
+
+	g_thread_pool_push(pool->threads, work, NULL);
+}
+
+void work_group_wait(struct work_group *group)
+{
+	g_mutex_lock(&group->lock);
+	while (group->pending)
+		g_cond_wait(&group->done, &group->lock);
+	g_mutex_unlock(&group->lock);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Threads for the per update pixel work, shared by all capture threads.
+ * Jobs embed struct work as their first member and belong to a group, the
+ * caller waits for its group before it reuses or frees the jobs.
+ */
+struct work_group {
+	GMutex lock;
+	GCond done;
+	int pending;
+};
+
+struct work {
+	void (*run)(struct work *work);
+	struct work_group *group;
+};
+
+struct work_pool {
+	GThreadPool *threads;
+};
+
+int work_pool_init(struct work_pool *pool, int threads);
+void work_pool_cleanup(struct work_pool *pool);
+
+void work_group_init(struct work_group *group);
+void work_group_clear(struct work_group *group);
+
+void work_pool_push(struct work_pool *pool, struct work_group *group, struct work *work);
+/* blocks until every job pushed with group has run */
+void work_group_wait(struct work_group *group);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
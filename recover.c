@@ -0,0 +1,58 @@
+#include "recover.h"
+
+void recovery_init(struct recovery *recovery)
+{
+	recovery->failures = 0;
+	recovery->recovering = 0;
+	recovery->lost_at = 0;
+	recovery->running_since = 0;
+}
+
+int64_t recovery_failed(struct recovery *recovery, int64_t now, int lost)
+{
+	int64_t delay = RECOVERY_MIN_US;
+	int i;
+
+	if (!recovery->recovering) {
+		recovery->recovering = 1;
+		recovery->lost_at = now;
+		/* failures before a stable run do not count, even if no new duplication can be made */
+		if (now - recovery->running_since >= RECOVERY_STABLE_US) {
+			recovery->failures = 0;
+			if (lost)
+				return 0;
+		}
+	}
+
+	for (i = 0; i < recovery->failures && delay < RECOVERY_MAX_US; ++i)
+		delay *= 2;
+	recovery->failures++;
+
+	return delay < RECOVERY_MAX_US ? delay : RECOVERY_MAX_US;
+}
+
+int64_t recovery_succeeded(struct recovery *recovery, int64_t now)
+{
+	recovery->running_since = now;
+	if (!recovery->recovering)
+		return -1;
+
+	recovery->recovering = 0;
+
+	return now - recovery->lost_at;
+}
+
+int recovery_retry(struct recovery *recovery, int64_t delay, const struct recovery_source *source)
+{
+	int failed = 0;
+
+	for (;;) {
+		if (delay > 0)
+			source->wait(source->data, delay);
+		if (source->attempt(source->data) == 0)
+			return failed;
+
+		failed++;
+		delay = recovery_failed(recovery, source->now(source->data), 0);
+	}
+}
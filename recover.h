@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define RECOVERY_MIN_US (50 * 1000)
+#define RECOVERY_MAX_US (5 * 1000 * 1000)
+/* a duplication lost sooner after it started counts as a failed attempt */
+#define RECOVERY_STABLE_US (2 * 1000 * 1000)
+
+/*
+ * Restarting the capture after a lost duplication. A loss after a stable
+ * run is retried at once, repeated failures (secure desktop, device being
+ * reset, a duplication lost right away) back off exponentially. Times in us.
+ */
+struct recovery {
+	int failures;			/* attempts since the last stable run */
+	int recovering;
+	int64_t lost_at;
+	int64_t running_since;
+};
+
+void recovery_init(struct recovery *recovery);
+
+/*
+ * A duplication was lost, or with lost 0 could not be created. Returns the
+ * time to wait before the next attempt.
+ */
+int64_t recovery_failed(struct recovery *recovery, int64_t now, int lost);
+
+/* capture runs again, returns the time since the loss or -1 if none */
+int64_t recovery_succeeded(struct recovery *recovery, int64_t now);
+
+/* what the restart loop works on, the capture or a simulation of it */
+struct recovery_source {
+	void *data;
+	/* sets up the capture again, 0 on success */
+	int (*attempt)(void *data);
+	/* blocks for us before the next attempt */
+	void (*wait)(void *data, int64_t us);
+	int64_t (*now)(void *data);
+};
+
+/*
+ * Waits delay, as returned by recovery_failed for the loss, and attempts
+ * until an attempt succeeds, backing off after every failure. Returns the
+ * number of failed attempts.
+ */
+int recovery_retry(struct recovery *recovery, int64_t delay, const struct recovery_source *source);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
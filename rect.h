@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Half-open rectangle, same convention as the win32 RECT: right and bottom
+ * are one past the last pixel.
+ */
+struct rect {
+	int left;
+	int top;
+	int right;
+	int bottom;
+};
+
+static inline int rect_width(const struct rect *r)
+{
+	return r->right - r->left;
+}
+
+static inline int rect_height(const struct rect *r)
+{
+	return r->bottom - r->top;
+}
+
+static inline int rect_is_empty(const struct rect *r)
+{
+	return r->right <= r->left || r->bottom <= r->top;
+}
+
+static inline int rect_intersect(struct rect *dst, const struct rect *a, const struct rect *b)
+{
+	dst->left = a->left > b->left ? a->left : b->left;
+	dst->top = a->top > b->top ? a->top : b->top;
+	dst->right = a->right < b->right ? a->right : b->right;
+	dst->bottom = a->bottom < b->bottom ? a->bottom : b->bottom;
+
+	return !rect_is_empty(dst);
+}
+
+static inline void rect_translate(struct rect *r, int dx, int dy)
+{
+	r->left += dx;
+	r->top += dy;
+	r->right += dx;
+	r->bottom += dy;
+}
+
+/* bounding box of a and b */
+static inline void rect_union(struct rect *dst, const struct rect *a, const struct rect *b)
+{
+	dst->left = a->left < b->left ? a->left : b->left;
+	dst->top = a->top < b->top ? a->top : b->top;
+	dst->right = a->right > b->right ? a->right : b->right;
+	dst->bottom = a->bottom > b->bottom ? a->bottom : b->bottom;
+}
+
+static inline int64_t rect_area(const struct rect *r)
+{
+	return rect_is_empty(r) ? 0 : (int64_t) rect_width(r) * rect_height(r);
+}
@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "refine.h"
+
+int refine_init(struct refine_map *map, int width, int height)
+{
+	memset(map, 0, sizeof(*map));
+
+	map->width = width;
+	map->height = height;
+	map->cols = (width + REFINE_TILE - 1) / REFINE_TILE;
+	map->rows = (height + REFINE_TILE - 1) / REFINE_TILE;
+	map->tiles = calloc(map->cols * map->rows, 1);
+	if (!map->tiles)
+		return -1;
+
+	return 0;
+}
+
+void refine_cleanup(struct refine_map *map)
+{
+	free(map->tiles);
+	memset(map, 0, sizeof(*map));
+}
+
+static void refine_set(struct refine_map *map, int col, int row, uint8_t value)
+{
+	uint8_t *tile = &map->tiles[row * map->cols + col];
+
+	map->pending += value - *tile;
+	*tile = value;
+}
+
+void refine_mark(struct refine_map *map, const struct rect *rect)
+{
+	int col, row;
+
+	if (rect_is_empty(rect))
+		return;
+
+	for (row = rect->top / REFINE_TILE; row <= (rect->bottom - 1) / REFINE_TILE && row < map->rows; ++row)
+		for (col = rect->left / REFINE_TILE; col <= (rect->right - 1) / REFINE_TILE && col < map->cols; ++col)
+			refine_set(map, col, row, 1);
+}
+
+void refine_clear(struct refine_map *map, const struct rect *rect)
+{
+	int col, row;
+
+	if (!map->pending || rect_is_empty(rect))
+		return;
+
+	for (row = rect->top / REFINE_TILE; row <= (rect->bottom - 1) / REFINE_TILE && row < map->rows; ++row) {
+		for (col = rect->left / REFINE_TILE; col <= (rect->right - 1) / REFINE_TILE && col < map->cols; ++col) {
+			struct rect tile = {
+				col * REFINE_TILE,
+				row * REFINE_TILE,
+				(col + 1) * REFINE_TILE < map->width ? (col + 1) * REFINE_TILE : map->width,
+				(row + 1) * REFINE_TILE < map->height ? (row + 1) * REFINE_TILE : map->height
+			};
+
+			if (rect->left <= tile.left && rect->top <= tile.top &&
+				rect->right >= tile.right && rect->bottom >= tile.bottom)
+				refine_set(map, col, row, 0);
+		}
+	}
+}
+
+int refine_next(struct refine_map *map, const struct rect *area, int x, int y, struct rect *tile)
+{
+	int64_t best = -1;
+	int pick = 0;
+	int col, row;
+
+	if (!map->pending || rect_is_empty(area))
+		return 0;
+
+	for (row = area->top / REFINE_TILE; row <= (area->bottom - 1) / REFINE_TILE && row < map->rows; ++row) {
+		for (col = area->left / REFINE_TILE; col <= (area->right - 1) / REFINE_TILE && col < map->cols; ++col) {
+			int64_t dx, dy, dist;
+
+			if (!map->tiles[row * map->cols + col])
+				continue;
+
+			dx = col * REFINE_TILE + REFINE_TILE / 2 - x;
+			dy = row * REFINE_TILE + REFINE_TILE / 2 - y;
+			dist = dx * dx + dy * dy;
+			if (best < 0 || dist < best) {
+				best = dist;
+				pick = row * map->cols + col;
+			}
+		}
+	}
+
+	if (best < 0)
+		return 0;
+
+	refine_set(map, pick % map->cols, pick / map->cols, 0);
+
+	tile->left = (pick % map->cols) * REFINE_TILE;
+	tile->top = (pick / map->cols) * REFINE_TILE;
+	tile->right = tile->left + REFINE_TILE < map->width ? tile->left + REFINE_TILE : map->width;
+	tile->bottom = tile->top + REFINE_TILE < map->height ? tile->top + REFINE_TILE : map->height;
+
+	return 1;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "rect.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define REFINE_TILE 64
+
+/*
+ * Tiles of the surface whose last update may have been compressed lossy.
+ * They are sent again losslessly once the screen is quiet.
+ */
+struct refine_map {
+	int width;
+	int height;
+	int cols;
+	int rows;
+	uint8_t *tiles;
+	int pending;
+};
+
+int refine_init(struct refine_map *map, int width, int height);
+void refine_cleanup(struct refine_map *map);
+
+/* rect was sent lossy */
+void refine_mark(struct refine_map *map, const struct rect *rect);
+/* rect was sent losslessly, clears the tiles it covers completely */
+void refine_clear(struct refine_map *map, const struct rect *rect);
+
+/*
+ * pops the pending tile in area closest to x, y; returns 0 if there is
+ * none. Tiles on the edge of area are returned whole.
+ */
+int refine_next(struct refine_map *map, const struct rect *area, int x, int y, struct rect *tile);
+
+static inline int refine_pending(const struct refine_map *map)
+{
+	return map->pending;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,63 @@
+#include "region.h"
+
+void region_init(struct region *region)
+{
+	region->count = 0;
+}
+
+static void region_remove(struct region *region, int index)
+{
+	region->rects[index] = region->rects[--region->count];
+}
+
+/* grows r by every rect it overlaps, the bounding box may overlap further ones */
+static void region_absorb(struct region *region, struct rect *r)
+{
+	struct rect overlap;
+	int i = 0;
+
+	while (i < region->count) {
+		if (rect_intersect(&overlap, &region->rects[i], r)) {
+			rect_union(r, r, &region->rects[i]);
+			region_remove(region, i);
+			i = 0;
+		} else {
+			++i;
+		}
+	}
+}
+
+void region_add(struct region *region, const struct rect *rect)
+{
+	struct rect r = *rect;
+	int i;
+
+	if (rect_is_empty(&r))
+		return;
+
+	region_absorb(region, &r);
+
+	while (region->count == REGION_MAX_RECTS) {
+		int64_t best = -1;
+		int pick = 0;
+
+		/* merge r with the rect that wastes the least area */
+		for (i = 0; i < region->count; ++i) {
+			struct rect u;
+			int64_t waste;
+
+			rect_union(&u, &r, &region->rects[i]);
+			waste = rect_area(&u) - rect_area(&r) - rect_area(&region->rects[i]);
+			if (best < 0 || waste < best) {
+				best = waste;
+				pick = i;
+			}
+		}
+
+		rect_union(&r, &r, &region->rects[pick]);
+		region_remove(region, pick);
+		region_absorb(region, &r);
+	}
+
+	region->rects[region->count++] = r;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "rect.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define REGION_MAX_RECTS 32
+
+/*
+ * Damage accumulated between sends as disjoint rectangles. Overlapping
+ * rectangles are merged into their bounding box, once the region is full
+ * the cheapest pair to merge is combined.
+ */
+struct region {
+	struct rect rects[REGION_MAX_RECTS];
+	int count;
+};
+
+void region_init(struct region *region);
+void region_add(struct region *region, const struct rect *rect);
+
+static inline int region_is_empty(const struct region *region)
+{
+	return !region->count;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,242 @@
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "rotate.h"
+
+/* blocks of ROTATE_TILE x ROTATE_TILE pixels keep source and destination lines in cache */
+#define ROTATE_TILE 64
+
+void rotation_rect_to_desktop(enum rotation rotation, int width, int height,
+							  const struct rect *in, struct rect *out)
+{
+	struct rect r = *in;
+
+	switch (rotation) {
+	case ROTATION_90:
+		out->left = width - r.bottom;
+		out->top = r.left;
+		out->right = width - r.top;
+		out->bottom = r.right;
+		break;
+	case ROTATION_180:
+		out->left = width - r.right;
+		out->top = height - r.bottom;
+		out->right = width - r.left;
+		out->bottom = height - r.top;
+		break;
+	case ROTATION_270:
+		out->left = r.top;
+		out->top = height - r.right;
+		out->right = r.bottom;
+		out->bottom = height - r.left;
+		break;
+	default:
+		*out = r;
+		break;
+	}
+}
+
+void rotation_rect_to_texture(enum rotation rotation, int width, int height,
+							  const struct rect *in, struct rect *out)
+{
+	struct rect r = *in;
+
+	switch (rotation) {
+	case ROTATION_90:
+		out->left = r.top;
+		out->top = width - r.right;
+		out->right = r.bottom;
+		out->bottom = width - r.left;
+		break;
+	case ROTATION_180:
+		out->left = width - r.right;
+		out->top = height - r.bottom;
+		out->right = width - r.left;
+		out->bottom = height - r.top;
+		break;
+	case ROTATION_270:
+		out->left = height - r.bottom;
+		out->top = r.left;
+		out->right = height - r.top;
+		out->bottom = r.right;
+		break;
+	default:
+		*out = r;
+		break;
+	}
+}
+
+static inline const uint32_t *src_row(const uint8_t *src, int stride, int y)
+{
+	return (const uint32_t *) (src + y * stride);
+}
+
+static inline uint32_t *dst_row(uint8_t *dst, int stride, int y)
+{
+	return (uint32_t *) (dst + y * stride);
+}
+
+#ifdef __SSE2__
+static inline void transpose4(__m128i *r0, __m128i *r1, __m128i *r2, __m128i *r3)
+{
+	__m128i t0 = _mm_unpacklo_epi32(*r0, *r1);
+	__m128i t1 = _mm_unpacklo_epi32(*r2, *r3);
+	__m128i t2 = _mm_unpackhi_epi32(*r0, *r1);
+	__m128i t3 = _mm_unpackhi_epi32(*r2, *r3);
+
+	*r0 = _mm_unpacklo_epi64(t0, t1);
+	*r1 = _mm_unpackhi_epi64(t0, t1);
+	*r2 = _mm_unpacklo_epi64(t2, t3);
+	*r3 = _mm_unpackhi_epi64(t2, t3);
+}
+#endif
+
+static void copy_0(const uint8_t *src, int src_stride, int src_width, int src_height,
+				   uint8_t *dst, int dst_stride)
+{
+	int y;
+
+	for (y = 0; y < src_height; ++y)
+		memcpy(dst + y * dst_stride, src + y * src_stride, src_width * 4);
+}
+
+static void copy_180(const uint8_t *src, int src_stride, int src_width, int src_height,
+					 uint8_t *dst, int dst_stride)
+{
+	int x, y;
+
+	for (y = 0; y < src_height; ++y) {
+		const uint32_t *in = src_row(src, src_stride, src_height - 1 - y);
+		uint32_t *out = dst_row(dst, dst_stride, y);
+
+		x = 0;
+#ifdef __SSE2__
+		for (; x + 4 <= src_width; x += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (in + src_width - 4 - x));
+			_mm_storeu_si128((__m128i *) (out + x), _mm_shuffle_epi32(v, 0x1b));
+		}
+#endif
+		for (; x < src_width; ++x)
+			out[x] = in[src_width - 1 - x];
+	}
+}
+
+/* dst(x, y) = src(y, src_height - 1 - x) */
+static void copy_90(const uint8_t *src, int src_stride, int src_width, int src_height,
+					uint8_t *dst, int dst_stride)
+{
+	int dst_width = src_height, dst_height = src_width;
+	int tx, ty, x, y;
+
+	for (ty = 0; ty < dst_height; ty += ROTATE_TILE) {
+		int y_end = ty + ROTATE_TILE < dst_height ? ty + ROTATE_TILE : dst_height;
+
+		for (tx = 0; tx < dst_width; tx += ROTATE_TILE) {
+			int x_end = tx + ROTATE_TILE < dst_width ? tx + ROTATE_TILE : dst_width;
+
+			y = ty;
+#ifdef __SSE2__
+			for (; y + 4 <= y_end; y += 4) {
+				for (x = tx; x + 4 <= x_end; x += 4) {
+					__m128i r0 = _mm_loadu_si128((const __m128i *) (src_row(src, src_stride, src_height - 1 - x) + y));
+					__m128i r1 = _mm_loadu_si128((const __m128i *) (src_row(src, src_stride, src_height - 2 - x) + y));
+					__m128i r2 = _mm_loadu_si128((const __m128i *) (src_row(src, src_stride, src_height - 3 - x) + y));
+					__m128i r3 = _mm_loadu_si128((const __m128i *) (src_row(src, src_stride, src_height - 4 - x) + y));
+
+					transpose4(&r0, &r1, &r2, &r3);
+
+					_mm_storeu_si128((__m128i *) (dst_row(dst, dst_stride, y) + x), r0);
+					_mm_storeu_si128((__m128i *) (dst_row(dst, dst_stride, y + 1) + x), r1);
+					_mm_storeu_si128((__m128i *) (dst_row(dst, dst_stride, y + 2) + x), r2);
+					_mm_storeu_si128((__m128i *) (dst_row(dst, dst_stride, y + 3) + x), r3);
+				}
+				for (; x < x_end; ++x) {
+					const uint32_t *in = src_row(src, src_stride, src_height - 1 - x);
+					dst_row(dst, dst_stride, y)[x] = in[y];
+					dst_row(dst, dst_stride, y + 1)[x] = in[y + 1];
+					dst_row(dst, dst_stride, y + 2)[x] = in[y + 2];
+					dst_row(dst, dst_stride, y + 3)[x] = in[y + 3];
+				}
+			}
+#endif
+			for (; y < y_end; ++y) {
+				uint32_t *out = dst_row(dst, dst_stride, y);
+				for (x = tx; x < x_end; ++x)
+					out[x] = src_row(src, src_stride, src_height - 1 - x)[y];
+			}
+		}
+	}
+}
+
+/* dst(x, y) = src(src_width - 1 - y, x) */
+static void copy_270(const uint8_t *src, int src_stride, int src_width, int src_height,
+					 uint8_t *dst, int dst_stride)
+{
+	int dst_width = src_height, dst_height = src_width;
+	int tx, ty, x, y;
+
+	for (ty = 0; ty < dst_height; ty += ROTATE_TILE) {
+		int y_end = ty + ROTATE_TILE < dst_height ? ty + ROTATE_TILE : dst_height;
+
+		for (tx = 0; tx < dst_width; tx += ROTATE_TILE) {
+			int x_end = tx + ROTATE_TILE < dst_width ? tx + ROTATE_TILE : dst_width;
+
+			y = ty;
+#ifdef __SSE2__
+			for (; y + 4 <= y_end; y += 4) {
+				int col = src_width - 4 - y;
+
+				for (x = tx; x + 4 <= x_end; x += 4) {
+					__m128i r0 = _mm_loadu_si128((const __m128i *) (src_row(src, src_stride, x) + col));
+					__m128i r1 = _mm_loadu_si128((const __m128i *) (src_row(src, src_stride, x + 1) + col));
+					__m128i r2 = _mm_loadu_si128((const __m128i *) (src_row(src, src_stride, x + 2) + col));
+					__m128i r3 = _mm_loadu_si128((const __m128i *) (src_row(src, src_stride, x + 3) + col));
+
+					transpose4(&r0, &r1, &r2, &r3);
+
+					/* columns were loaded right to left */
+					_mm_storeu_si128((__m128i *) (dst_row(dst, dst_stride, y) + x), r3);
+					_mm_storeu_si128((__m128i *) (dst_row(dst, dst_stride, y + 1) + x), r2);
+					_mm_storeu_si128((__m128i *) (dst_row(dst, dst_stride, y + 2) + x), r1);
+					_mm_storeu_si128((__m128i *) (dst_row(dst, dst_stride, y + 3) + x), r0);
+				}
+				for (; x < x_end; ++x) {
+					const uint32_t *in = src_row(src, src_stride, x) + col;
+					dst_row(dst, dst_stride, y)[x] = in[3];
+					dst_row(dst, dst_stride, y + 1)[x] = in[2];
+					dst_row(dst, dst_stride, y + 2)[x] = in[1];
+					dst_row(dst, dst_stride, y + 3)[x] = in[0];
+				}
+			}
+#endif
+			for (; y < y_end; ++y) {
+				uint32_t *out = dst_row(dst, dst_stride, y);
+				for (x = tx; x < x_end; ++x)
+					out[x] = src_row(src, src_stride, x)[src_width - 1 - y];
+			}
+		}
+	}
+}
+
+void rotation_copy(enum rotation rotation,
+				   const uint8_t *src, int src_stride, int src_width, int src_height,
+				   uint8_t *dst, int dst_stride)
+{
+	switch (rotation) {
+	case ROTATION_90:
+		copy_90(src, src_stride, src_width, src_height, dst, dst_stride);
+		break;
+	case ROTATION_180:
+		copy_180(src, src_stride, src_width, src_height, dst, dst_stride);
+		break;
+	case ROTATION_270:
+		copy_270(src, src_stride, src_width, src_height, dst, dst_stride);
+		break;
+	default:
+		copy_0(src, src_stride, src_width, src_height, dst, dst_stride);
+		break;
+	}
+}
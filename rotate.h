@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "rect.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* clockwise rotation of the desktop relative to the duplicated texture */
+enum rotation {
+	ROTATION_0,
+	ROTATION_90,
+	ROTATION_180,
+	ROTATION_270,
+};
+
+/*
+ * Rectangle transforms between texture and desktop space, width and height
+ * are the size of the desktop, i.e. after rotation.
+ */
+void rotation_rect_to_desktop(enum rotation rotation, int width, int height,
+							  const struct rect *in, struct rect *out);
+void rotation_rect_to_texture(enum rotation rotation, int width, int height,
+							  const struct rect *in, struct rect *out);
+
+/*
+ * Copies a src_width x src_height block of 32 bit pixels from texture
+ * orientation to desktop orientation. For 90 and 270 degrees the
+ * destination block is src_height pixels wide.
+ */
+void rotation_copy(enum rotation rotation,
+				   const uint8_t *src, int src_stride, int src_width, int src_height,
+				   uint8_t *dst, int dst_stride);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,403 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "scale.h"
+
+int scale_filter_parse(const char *name, enum scale_filter *filter)
+{
+	if (!strcmp(name, "box"))
+		*filter = SCALE_FILTER_BOX;
+	else if (!strcmp(name, "bilinear"))
+		*filter = SCALE_FILTER_BILINEAR;
+	else
+		return -1;
+
+	return 0;
+}
+
+static void axis_free(struct scale_axis *axis)
+{
+	free(axis->first);
+	free(axis->last);
+	free(axis->frac);
+	free(axis->weight);
+	memset(axis, 0, sizeof(*axis));
+}
+
+/*
+ * Area weights of the box filter. Destination pixel i covers the source
+ * interval [i * src, (i + 1) * src) / dst, in units of 1 / dst source
+ * pixels a source pixel is dst units wide and the footprint src units.
+ */
+static int axis_init_weights(struct scale_axis *axis, int src, int dst)
+{
+	int i, k;
+
+	axis->taps = 1;
+	for (i = 0; i < dst; ++i)
+		if (axis->last[i] - axis->first[i] > axis->taps)
+			axis->taps = axis->last[i] - axis->first[i];
+
+	axis->weight = calloc((size_t) dst * axis->taps, sizeof(*axis->weight));
+	if (!axis->weight)
+		return -1;
+
+	for (i = 0; i < dst; ++i) {
+		uint16_t *w = &axis->weight[(size_t) i * axis->taps];
+		int64_t begin = (int64_t) i * src, end = (int64_t) (i + 1) * src;
+		int sum = 0, largest = 0;
+
+		for (k = 0; k < axis->last[i] - axis->first[i]; ++k) {
+			int64_t left = (int64_t) (axis->first[i] + k) * dst, right = left + dst;
+			int64_t covered = (right < end ? right : end) - (left > begin ? left : begin);
+
+			w[k] = (uint16_t) ((covered * 256 + src / 2) / src);
+			sum += w[k];
+			if (w[k] > w[largest])
+				largest = k;
+		}
+
+		/* rounding may miss 256 by a little, the largest share absorbs it */
+		w[largest] = (uint16_t) (w[largest] + 256 - sum);
+	}
+
+	return 0;
+}
+
+static int axis_init(struct scale_axis *axis, int src, int dst, enum scale_filter filter)
+{
+	int i;
+
+	memset(axis, 0, sizeof(*axis));
+	axis->first = malloc(dst * sizeof(*axis->first));
+	axis->last = malloc(dst * sizeof(*axis->last));
+	axis->frac = calloc(dst, sizeof(*axis->frac));
+	if (!axis->first || !axis->last || !axis->frac) {
+		axis_free(axis);
+		return -1;
+	}
+
+	for (i = 0; i < dst; ++i) {
+		if (filter == SCALE_FILTER_BILINEAR) {
+			/* center of the destination pixel in 1/256 source pixels */
+			int64_t pos = ((int64_t) (2 * i + 1) * src * 256) / (2 * dst) - 128;
+			int first;
+			int frac;
+
+			if (pos < 0)
+				pos = 0;
+			first = (int) (pos >> 8);
+			frac = (int) (pos & 0xff);
+			if (first >= src - 1) {
+				first = src - 2;
+				frac = 256;
+			}
+
+			axis->first[i] = first;
+			axis->last[i] = first + 2;
+			axis->frac[i] = frac;
+		} else {
+			int first = (int) (((int64_t) i * src) / dst);
+			int last = (int) (((int64_t) (i + 1) * src + dst - 1) / dst);
+
+			axis->first[i] = first;
+			axis->last[i] = last > first ? last : first + 1;
+		}
+	}
+
+	if (filter == SCALE_FILTER_BOX && axis_init_weights(axis, src, dst) < 0) {
+		axis_free(axis);
+		return -1;
+	}
+
+	return 0;
+}
+
+int scaler_init(struct scaler *scaler, int src_width, int src_height,
+				int dst_width, int dst_height, enum scale_filter filter)
+{
+	memset(scaler, 0, sizeof(*scaler));
+
+	if (src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0)
+		return -1;
+
+	/* bilinear needs two source pixels per axis */
+	if (src_width < 2 || src_height < 2)
+		filter = SCALE_FILTER_BOX;
+
+	scaler->src_width = src_width;
+	scaler->src_height = src_height;
+	scaler->dst_width = dst_width;
+	scaler->dst_height = dst_height;
+	scaler->filter = filter;
+
+	if (scaler_is_identity(scaler))
+		return 0;
+
+	if (axis_init(&scaler->x, src_width, dst_width, filter) < 0 ||
+		axis_init(&scaler->y, src_height, dst_height, filter) < 0) {
+		scaler_cleanup(scaler);
+		return -1;
+	}
+
+	return 0;
+}
+
+void scaler_cleanup(struct scaler *scaler)
+{
+	axis_free(&scaler->x);
+	axis_free(&scaler->y);
+}
+
+int scaler_is_identity(const struct scaler *scaler)
+{
+	return scaler->src_width == scaler->dst_width && scaler->src_height == scaler->dst_height;
+}
+
+/* first destination pixel whose footprint ends behind pos */
+static int axis_lower(const struct scale_axis *axis, int n, int pos)
+{
+	int lo = 0, hi = n;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (axis->last[mid] > pos)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+/* one past the last destination pixel whose footprint starts before pos */
+static int axis_upper(const struct scale_axis *axis, int n, int pos)
+{
+	int lo = 0, hi = n;
+
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (axis->first[mid] < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+void scaler_map_rect(const struct scaler *scaler, const struct rect *dirty,
+					 struct rect *dst, struct rect *src)
+{
+	if (scaler_is_identity(scaler)) {
+		*dst = *dirty;
+		*src = *dirty;
+		return;
+	}
+
+	dst->left = axis_lower(&scaler->x, scaler->dst_width, dirty->left);
+	dst->right = axis_upper(&scaler->x, scaler->dst_width, dirty->right);
+	dst->top = axis_lower(&scaler->y, scaler->dst_height, dirty->top);
+	dst->bottom = axis_upper(&scaler->y, scaler->dst_height, dirty->bottom);
+
+	if (rect_is_empty(dst)) {
+		memset(dst, 0, sizeof(*dst));
+		memset(src, 0, sizeof(*src));
+		return;
+	}
+
+	/* tables are monotonic, so the outer pixels span the whole footprint */
+	src->left = scaler->x.first[dst->left];
+	src->right = scaler->x.last[dst->right - 1];
+	src->top = scaler->y.first[dst->top];
+	src->bottom = scaler->y.last[dst->bottom - 1];
+}
+
+static int map_coord(int v, int from, int to)
+{
+	v = (int) (((int64_t) (2 * v + 1) * to) / (2 * from));
+
+	if (v < 0)
+		return 0;
+	if (v >= to)
+		return to - 1;
+
+	return v;
+}
+
+void scaler_map_point_to_src(const struct scaler *scaler, int *x, int *y)
+{
+	if (scaler_is_identity(scaler) || !scaler->dst_width || !scaler->dst_height)
+		return;
+
+	*x = map_coord(*x, scaler->dst_width, scaler->src_width);
+	*y = map_coord(*y, scaler->dst_height, scaler->src_height);
+}
+
+void scaler_map_point_to_dst(const struct scaler *scaler, int *x, int *y)
+{
+	if (scaler_is_identity(scaler) || !scaler->src_width || !scaler->src_height)
+		return;
+
+	*x = map_coord(*x, scaler->src_width, scaler->dst_width);
+	*y = map_coord(*y, scaler->src_height, scaler->dst_height);
+}
+
+/*
+ * The box filter runs in two passes with the same rounding on every path.
+ * The vertical pass blends the source rows of a destination row into one
+ * row, the horizontal pass blends its columns. Weights sum up to 256, so
+ * every sum of weighted 8 bit channels fits in 16 bits.
+ */
+static void box_rows(const uint8_t *row, int stride, int width, const uint16_t *weight, int taps,
+					 uint8_t *out)
+{
+	int i = 0, k;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(128);
+
+	/* four pixels at a time */
+	for (; i + 16 <= width * 4; i += 16) {
+		__m128i lo = round, hi = round;
+
+		for (k = 0; k < taps; ++k) {
+			__m128i px = _mm_loadu_si128((const __m128i *) (row + k * stride + i));
+			__m128i w = _mm_set1_epi16((short) weight[k]);
+
+			lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), w));
+			hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(px, zero), w));
+		}
+
+		_mm_storeu_si128((__m128i *) (out + i),
+						 _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+#endif
+
+	for (; i < width * 4; ++i) {
+		unsigned int sum = 128;
+
+		for (k = 0; k < taps; ++k)
+			sum += row[k * stride + i] * weight[k];
+		out[i] = (uint8_t) (sum >> 8);
+	}
+}
+
+static void box_columns(const struct scale_axis *axis, int left, int right, int offset,
+						const uint8_t *row, uint32_t *out)
+{
+	int dx = left, k;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(128);
+
+	/* two destination pixels at a time, one per half of the register */
+	for (; dx + 2 <= right; dx += 2) {
+		const uint8_t *p0 = row + (axis->first[dx] - offset) * 4;
+		const uint8_t *p1 = row + (axis->first[dx + 1] - offset) * 4;
+		const uint16_t *w0 = &axis->weight[(size_t) dx * axis->taps];
+		const uint16_t *w1 = w0 + axis->taps;
+		__m128i acc = round;
+
+		for (k = 0; k < axis->taps; ++k) {
+			__m128i px = _mm_unpacklo_epi32(_mm_cvtsi32_si128(*(const int *) (p0 + k * 4)),
+											_mm_cvtsi32_si128(*(const int *) (p1 + k * 4)));
+			__m128i w = _mm_unpacklo_epi64(_mm_set1_epi16((short) w0[k]), _mm_set1_epi16((short) w1[k]));
+
+			acc = _mm_add_epi16(acc, _mm_mullo_epi16(_mm_unpacklo_epi8(px, zero), w));
+		}
+
+		_mm_storel_epi64((__m128i *) (out + dx - left), _mm_packus_epi16(_mm_srli_epi16(acc, 8), zero));
+	}
+#endif
+
+	for (; dx < right; ++dx) {
+		const uint8_t *p = row + (axis->first[dx] - offset) * 4;
+		const uint16_t *w = &axis->weight[(size_t) dx * axis->taps];
+		uint32_t pixel = 0;
+		int c;
+
+		for (c = 0; c < 4; ++c) {
+			unsigned int sum = 128;
+
+			for (k = 0; k < axis->taps; ++k)
+				sum += p[k * 4 + c] * w[k];
+			pixel |= (sum >> 8) << (8 * c);
+		}
+		out[dx - left] = pixel;
+	}
+}
+
+static uint32_t bilinear_pixel(const uint8_t *row0, const uint8_t *row1, int fx, int fy)
+{
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(128);
+	/* left pixel in lanes 0-3, right pixel in lanes 4-7 */
+	__m128i top = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) row0), zero);
+	__m128i bottom = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) row1), zero);
+	__m128i v, h;
+
+	v = _mm_add_epi16(_mm_mullo_epi16(top, _mm_set1_epi16((short) (256 - fy))),
+					  _mm_mullo_epi16(bottom, _mm_set1_epi16((short) fy)));
+	v = _mm_srli_epi16(_mm_add_epi16(v, round), 8);
+
+	h = _mm_add_epi16(_mm_mullo_epi16(v, _mm_set1_epi16((short) (256 - fx))),
+					  _mm_mullo_epi16(_mm_srli_si128(v, 8), _mm_set1_epi16((short) fx)));
+	h = _mm_srli_epi16(_mm_add_epi16(h, round), 8);
+
+	return (uint32_t) _mm_cvtsi128_si32(_mm_packus_epi16(h, zero));
+#else
+	uint32_t out = 0;
+	int c;
+
+	for (c = 0; c < 4; ++c) {
+		unsigned int l = (row0[c] * (256 - fy) + row1[c] * fy + 128) >> 8;
+		unsigned int r = (row0[4 + c] * (256 - fy) + row1[4 + c] * fy + 128) >> 8;
+		out |= ((l * (256 - fx) + r * fx + 128) >> 8) << (8 * c);
+	}
+
+	return out;
+#endif
+}
+
+void scaler_scale(const struct scaler *scaler,
+				  const struct rect *dst, uint8_t *dst_pixels, int dst_stride,
+				  const struct rect *src, const uint8_t *src_pixels, int src_stride)
+{
+	uint8_t *blended = NULL;
+	int dx, dy;
+
+	/* one blended source row, taps of slack for the footprints at its end */
+	if (scaler->filter == SCALE_FILTER_BOX) {
+		blended = calloc((size_t) rect_width(src) + scaler->x.taps, 4);
+		if (!blended)
+			return;
+	}
+
+	for (dy = dst->top; dy < dst->bottom; ++dy) {
+		uint32_t *out = (uint32_t *) (dst_pixels + (dy - dst->top) * dst_stride);
+		int y0 = scaler->y.first[dy];
+		const uint8_t *row = src_pixels + (y0 - src->top) * src_stride;
+
+		if (scaler->filter == SCALE_FILTER_BILINEAR) {
+			int fy = scaler->y.frac[dy];
+			for (dx = dst->left; dx < dst->right; ++dx) {
+				int x0 = scaler->x.first[dx] - src->left;
+				*out++ = bilinear_pixel(row + x0 * 4, row + src_stride + x0 * 4,
+										scaler->x.frac[dx], fy);
+			}
+		} else {
+			/* only the rows of this footprint, the rest may lie outside src */
+			box_rows(row, src_stride, rect_width(src), &scaler->y.weight[(size_t) dy * scaler->y.taps],
+					 scaler->y.last[dy] - y0, blended);
+			box_columns(&scaler->x, dst->left, dst->right, src->left, blended, out);
+		}
+	}
+
+	free(blended);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "rect.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+enum scale_filter {
+	SCALE_FILTER_BOX,
+	SCALE_FILTER_BILINEAR,
+};
+
+/*
+ * Per axis lookup tables, indexed by destination pixel.
+ * Source pixels [first, last) contribute to the destination pixel, for the
+ * bilinear filter frac is the weight (0..256) of pixel first + 1. For the
+ * box filter weight holds taps weights per destination pixel, the share
+ * of the footprint source pixels first, first + 1, ... cover, in 1/256
+ * and summing up to 256. Unused taps are 0.
+ */
+struct scale_axis {
+	int *first;
+	int *last;
+	uint16_t *frac;
+	uint16_t *weight;
+	int taps;
+};
+
+struct scaler {
+	int src_width;
+	int src_height;
+	int dst_width;
+	int dst_height;
+	enum scale_filter filter;
+	struct scale_axis x;
+	struct scale_axis y;
+};
+
+int scale_filter_parse(const char *name, enum scale_filter *filter);
+
+int scaler_init(struct scaler *scaler, int src_width, int src_height,
+				int dst_width, int dst_height, enum scale_filter filter);
+void scaler_cleanup(struct scaler *scaler);
+int scaler_is_identity(const struct scaler *scaler);
+
+/*
+ * Maps a dirty rectangle in source coordinates to the destination
+ * rectangle that has to be resent and the source area the filter needs to
+ * compute it. The source area is usually larger than the dirty rectangle.
+ */
+void scaler_map_rect(const struct scaler *scaler, const struct rect *dirty,
+					 struct rect *dst, struct rect *src);
+void scaler_map_point_to_src(const struct scaler *scaler, int *x, int *y);
+void scaler_map_point_to_dst(const struct scaler *scaler, int *x, int *y);
+
+/*
+ * Resamples the destination rectangle dst. src_pixels holds the source area
+ * src as returned by scaler_map_rect, both buffers are 32 bit per pixel.
+ */
+void scaler_scale(const struct scaler *scaler,
+				  const struct rect *dst, uint8_t *dst_pixels, int dst_stride,
+				  const struct rect *src, const uint8_t *src_pixels, int src_stride);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
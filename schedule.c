@@ -0,0 +1,133 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "schedule.h"
+
+/* only the oldest items are candidates, keeps pop cheap with many tiles */
+#define SCHED_WINDOW 64
+
+/* cost in pixels of distance: waiting 1 ms is worth 8 pixels */
+#define SCHED_AGE_WEIGHT 8.0
+#define SCHED_BULK_PENALTY 512.0
+
+int scheduler_init(struct scheduler *scheduler)
+{
+	memset(scheduler, 0, sizeof(*scheduler));
+
+	scheduler->capacity = 64;
+	scheduler->items = malloc(scheduler->capacity * sizeof(*scheduler->items));
+	if (!scheduler->items)
+		return -1;
+
+	return 0;
+}
+
+void scheduler_cleanup(struct scheduler *scheduler)
+{
+	free(scheduler->items);
+	memset(scheduler, 0, sizeof(*scheduler));
+}
+
+void scheduler_set_focus(struct scheduler *scheduler, int x, int y)
+{
+	scheduler->focus_x = x;
+	scheduler->focus_y = y;
+}
+
+int scheduler_push(struct scheduler *scheduler, const struct rect *rect, int bulk, void *data, int64_t now)
+{
+	struct sched_item *item;
+
+	if (scheduler->count == scheduler->capacity) {
+		int capacity = scheduler->capacity * 2;
+		struct sched_item *items = realloc(scheduler->items, capacity * sizeof(*items));
+
+		if (!items)
+			return -1;
+		scheduler->items = items;
+		scheduler->capacity = capacity;
+	}
+
+	/* items stay sorted by seq, the oldest first */
+	item = &scheduler->items[scheduler->count++];
+	item->rect = *rect;
+	item->seq = scheduler->next_seq++;
+	item->queued = now;
+	item->bulk = bulk;
+	item->data = data;
+
+	return 0;
+}
+
+/* an item may run once no older item overlaps it */
+static int is_ready(const struct scheduler *scheduler, int index)
+{
+	const struct rect *r = &scheduler->items[index].rect;
+	struct rect overlap;
+	int i;
+
+	for (i = 0; i < index; ++i)
+		if (rect_intersect(&overlap, &scheduler->items[i].rect, r))
+			return 0;
+
+	return 1;
+}
+
+static double item_cost(const struct scheduler *scheduler, const struct sched_item *item, int64_t now)
+{
+	const struct rect *r = &item->rect;
+	int dx = 0, dy = 0;
+	double cost;
+
+	if (scheduler->focus_x < r->left)
+		dx = r->left - scheduler->focus_x;
+	else if (scheduler->focus_x >= r->right)
+		dx = scheduler->focus_x - r->right + 1;
+	if (scheduler->focus_y < r->top)
+		dy = r->top - scheduler->focus_y;
+	else if (scheduler->focus_y >= r->bottom)
+		dy = scheduler->focus_y - r->bottom + 1;
+
+	cost = sqrt((double) dx * dx + (double) dy * dy);
+	cost += sqrt((double) rect_width(r) * rect_height(r));
+	cost -= SCHED_AGE_WEIGHT * (now - item->queued) / 1000.0;
+	if (item->bulk)
+		cost += SCHED_BULK_PENALTY;
+
+	return cost;
+}
+
+void *scheduler_pop(struct scheduler *scheduler, int64_t now, int64_t *waited)
+{
+	int window = scheduler->count < SCHED_WINDOW ? scheduler->count : SCHED_WINDOW;
+	int pick = 0;
+	double best = 0;
+	void *data;
+	int i;
+
+	if (!scheduler->count)
+		return NULL;
+
+	/* the oldest item is always ready */
+	if (!scheduler->fifo) {
+		best = item_cost(scheduler, &scheduler->items[0], now);
+		for (i = 1; i < window; ++i) {
+			double cost = item_cost(scheduler, &scheduler->items[i], now);
+
+			if (cost < best && is_ready(scheduler, i)) {
+				best = cost;
+				pick = i;
+			}
+		}
+	}
+
+	data = scheduler->items[pick].data;
+	if (waited)
+		*waited = now - scheduler->items[pick].queued;
+	memmove(&scheduler->items[pick], &scheduler->items[pick + 1],
+			(scheduler->count - pick - 1) * sizeof(*scheduler->items));
+	scheduler->count--;
+
+	return data;
+}
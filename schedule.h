@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "rect.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Queue of pending draw commands ordered by priority: commands close to
+ * the pointer, small commands and old commands go first, bulk commands
+ * (tiles of large updates) last. A command never overtakes an older
+ * command it overlaps, so the final pixels are the same as with a FIFO.
+ * Not thread safe, callers hold their own lock.
+ */
+struct sched_item {
+	struct rect rect;
+	uint64_t seq;
+	int64_t queued;	/* us */
+	int bulk;
+	void *data;
+};
+
+struct scheduler {
+	struct sched_item *items;
+	int count;
+	int capacity;
+	uint64_t next_seq;
+	int fifo;
+	int focus_x;
+	int focus_y;
+};
+
+int scheduler_init(struct scheduler *scheduler);
+void scheduler_cleanup(struct scheduler *scheduler);
+
+/* the pointer position in surface coordinates */
+void scheduler_set_focus(struct scheduler *scheduler, int x, int y);
+
+int scheduler_push(struct scheduler *scheduler, const struct rect *rect, int bulk, void *data, int64_t now);
+/* waited, if not NULL, receives the time in us the item spent queued */
+void *scheduler_pop(struct scheduler *scheduler, int64_t now, int64_t *waited);
+
+/* time in us the oldest item has been queued, 0 if the queue is empty */
+static inline int64_t scheduler_oldest(const struct scheduler *scheduler, int64_t now)
+{
+	return scheduler->count ? now - scheduler->items[0].queued : 0;
+}
+
+static inline int scheduler_length(const struct scheduler *scheduler)
+{
+	return scheduler->count;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
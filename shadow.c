@@ -0,0 +1,105 @@
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shadow.h"
+
+int shadow_init(struct shadow *shadow, int width, int height)
+{
+	memset(shadow, 0, sizeof(*shadow));
+	g_mutex_init(&shadow->lock);
+
+	shadow->width = width;
+	shadow->height = height;
+	shadow->stride = width * 4;
+	/* black until the first frame arrives */
+	shadow->pixels = calloc(height, shadow->stride);
+	if (!shadow->pixels)
+		return -1;
+
+	return 0;
+}
+
+void shadow_cleanup(struct shadow *shadow)
+{
+	free(shadow->pixels);
+	shadow->pixels = NULL;
+	g_mutex_clear(&shadow->lock);
+}
+
+int shadow_resize(struct shadow *shadow, int width, int height)
+{
+	uint8_t *pixels = calloc(height, width * 4);
+
+	if (!pixels)
+		return -1;
+
+	g_mutex_lock(&shadow->lock);
+	free(shadow->pixels);
+	shadow->width = width;
+	shadow->height = height;
+	shadow->stride = width * 4;
+	shadow->pixels = pixels;
+	g_mutex_unlock(&shadow->lock);
+
+	return 0;
+}
+
+/* clips rect to the framebuffer, returns 0 if nothing is left */
+static int shadow_clip(const struct shadow *shadow, const struct rect *rect, struct rect *clipped)
+{
+	struct rect bounds = { 0, 0, shadow->width, shadow->height };
+
+	return rect_intersect(clipped, &bounds, rect);
+}
+
+void shadow_write(struct shadow *shadow, const struct rect *rect, const uint8_t *pixels, int stride)
+{
+	struct rect r;
+	int y;
+
+	if (!shadow_clip(shadow, rect, &r))
+		return;
+
+	pixels += (r.top - rect->top) * stride + (r.left - rect->left) * 4;
+
+	g_mutex_lock(&shadow->lock);
+	for (y = r.top; y < r.bottom; ++y, pixels += stride)
+		memcpy(shadow->pixels + y * shadow->stride + r.left * 4, pixels, rect_width(&r) * 4);
+	g_mutex_unlock(&shadow->lock);
+}
+
+void shadow_read(struct shadow *shadow, const struct rect *rect, uint8_t *pixels, int stride)
+{
+	struct rect r;
+	int y;
+
+	if (!shadow_clip(shadow, rect, &r))
+		return;
+
+	pixels += (r.top - rect->top) * stride + (r.left - rect->left) * 4;
+
+	g_mutex_lock(&shadow->lock);
+	for (y = r.top; y < r.bottom; ++y, pixels += stride)
+		memcpy(pixels, shadow->pixels + y * shadow->stride + r.left * 4, rect_width(&r) * 4);
+	g_mutex_unlock(&shadow->lock);
+}
+
+int shadow_differs(struct shadow *shadow, const struct rect *rect, const uint8_t *pixels, int stride)
+{
+	struct rect r;
+	int differs = 0;
+	int y;
+
+	if (!shadow_clip(shadow, rect, &r))
+		return 0;
+
+	pixels += (r.top - rect->top) * stride + (r.left - rect->left) * 4;
+
+	g_mutex_lock(&shadow->lock);
+	for (y = r.top; y < r.bottom && !differs; ++y, pixels += stride)
+		differs = memcmp(pixels, shadow->pixels + y * shadow->stride + r.left * 4, rect_width(&r) * 4) != 0;
+	g_mutex_unlock(&shadow->lock);
+
+	return differs;
+}
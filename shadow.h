@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+#include "rect.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Copy of the desktop as sent to the clients, in surface coordinates and
+ * 32 bit BGRX. The display thread writes every update into it, new clients
+ * are bootstrapped from it. It is also the memory of the primary surface:
+ * spice renders the same drawables into it without taking the lock, which
+ * at worst briefly restores pixels a queued drawable is about to replace.
+ */
+struct shadow {
+	GMutex lock;
+	int width;
+	int height;
+	int stride;
+	uint8_t *pixels;
+};
+
+int shadow_init(struct shadow *shadow, int width, int height);
+void shadow_cleanup(struct shadow *shadow);
+/* replaces the framebuffer with a black one, the old memory is freed */
+int shadow_resize(struct shadow *shadow, int width, int height);
+
+void shadow_write(struct shadow *shadow, const struct rect *rect, const uint8_t *pixels, int stride);
+void shadow_read(struct shadow *shadow, const struct rect *rect, uint8_t *pixels, int stride);
+/* non-zero if the pixels differ from the framebuffer */
+int shadow_differs(struct shadow *shadow, const struct rect *rect, const uint8_t *pixels, int stride);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
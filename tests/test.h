@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Minimal checks for the unit tests. A failed check is reported and the
+ * test continues, main returns test_result().
+ */
+static int test_failures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++; \
+		} \
+	} while (0)
+
+#define CHECK_EQ(a, b) \
+	do { \
+		long long _a = (long long) (a), _b = (long long) (b); \
+		if (_a != _b) { \
+			fprintf(stderr, "%s:%d: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+			test_failures++; \
+		} \
+	} while (0)
+
+static inline int test_result(void)
+{
+	if (test_failures)
+		fprintf(stderr, "%d checks failed\n", test_failures);
+
+	return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+#include "bucket.h"
+#include "test.h"
+
+#define SECOND 1000000
+
+static void test_unlimited(void)
+{
+	struct token_bucket bucket;
+
+	token_bucket_init(&bucket, 0, 0, 0);
+	token_bucket_consume(&bucket, 1 << 30, 0);
+	CHECK_EQ(token_bucket_delay(&bucket, 0), 0);
+}
+
+static void test_burst(void)
+{
+	struct token_bucket bucket;
+
+	token_bucket_init(&bucket, 1000, 500, 0);
+
+	/* the burst is available at once, a send may overdraw it */
+	CHECK_EQ(token_bucket_delay(&bucket, 0), 0);
+	token_bucket_consume(&bucket, 700, 0);
+	CHECK_EQ(bucket.tokens, -200);
+
+	/* 200 bytes at 1000 bytes/s */
+	CHECK_EQ(token_bucket_delay(&bucket, 0), 200 * 1000);
+	CHECK_EQ(token_bucket_delay(&bucket, 100 * 1000), 100 * 1000);
+	CHECK_EQ(token_bucket_delay(&bucket, 200 * 1000), 0);
+
+	/* a long idle period refills up to the burst, not beyond */
+	CHECK_EQ(token_bucket_delay(&bucket, 60 * SECOND), 0);
+	CHECK_EQ(bucket.tokens, 500);
+}
+
+static void test_rate(void)
+{
+	struct token_bucket bucket;
+	int64_t now = 0, sent = 0;
+
+	/* 300 KB sends as often as allowed for 10 s at 1 MB/s and a 250 KB burst */
+	token_bucket_init(&bucket, 1000000, 250000, now);
+	while (now < 10 * SECOND) {
+		int64_t delay = token_bucket_delay(&bucket, now);
+
+		if (delay) {
+			now += delay;
+			continue;
+		}
+		token_bucket_consume(&bucket, 300000, now);
+		sent += 300000;
+		now += 1000;
+	}
+
+	/* rate * time plus the burst, give or take the send in flight */
+	CHECK(sent >= 10000000 && sent <= 10250000 + 300000);
+}
+
+/* refills every ms at 3 bytes/s add 0.003 bytes, the remainder must carry over */
+static void test_fractional_refill(void)
+{
+	struct token_bucket bucket;
+	int64_t now;
+	int sent = 0;
+
+	token_bucket_init(&bucket, 3, 10, 0);
+	token_bucket_consume(&bucket, 10, 0);
+	for (now = 1000; now <= 10 * SECOND; now += 1000) {
+		if (!token_bucket_delay(&bucket, now)) {
+			token_bucket_consume(&bucket, 1, now);
+			sent++;
+		}
+	}
+
+	CHECK_EQ(sent, 30);
+}
+
+/* idle periods far beyond what fills the bucket must not overflow the refill */
+static void test_long_idle(void)
+{
+	struct token_bucket bucket;
+	int64_t now = INT64_MAX / 2;
+
+	token_bucket_init(&bucket, 1000000000, 1000000000, 0);
+	token_bucket_consume(&bucket, 3000000000, 0);
+	CHECK_EQ(token_bucket_delay(&bucket, now), 0);
+	CHECK_EQ(bucket.tokens, 1000000000);
+
+	/* and the bucket keeps working afterwards */
+	token_bucket_consume(&bucket, 1500000000, now);
+	CHECK_EQ(token_bucket_delay(&bucket, now), 500000);
+	CHECK_EQ(token_bucket_delay(&bucket, now + 500000), 0);
+}
+
+int main(void)
+{
+	test_unlimited();
+	test_burst();
+	test_rate();
+	test_fractional_refill();
+	test_long_idle();
+
+	return test_result();
+}
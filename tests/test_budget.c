@@ -0,0 +1,141 @@
+#include <glib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "budget.h"
+#include "metrics.h"
+#include "test.h"
+
+#define FRAME_SIZE 1000
+#define LIMIT (4 * FRAME_SIZE + 500)
+#define FRAMES 200
+
+/*
+ * A slow client: spice releases the queued commands one at a time, a
+ * little later each. The queue only exists to hand sizes to the releaser.
+ */
+struct client {
+	struct mem_budget *budget;
+	GMutex lock;
+	GCond queued;
+	int pushed;
+	int released;
+	size_t peak;
+};
+
+static gpointer release_slowly(gpointer data)
+{
+	struct client *client = data;
+
+	for (;;) {
+		g_mutex_lock(&client->lock);
+		while (client->released == client->pushed && client->pushed < FRAMES)
+			g_cond_wait(&client->queued, &client->lock);
+		if (client->released == FRAMES) {
+			g_mutex_unlock(&client->lock);
+			return NULL;
+		}
+		client->released++;
+		g_mutex_unlock(&client->lock);
+
+		g_usleep(200);
+		mem_budget_release(client->budget, FRAME_SIZE);
+	}
+}
+
+/* the capture loop of display.cpp: wait while exhausted, then send a frame */
+static void test_slow_release(void)
+{
+	struct mem_budget budget;
+	struct client client;
+	GThread *thread;
+	unsigned int flushed = 0;
+	int i;
+
+	mem_budget_init(&budget, LIMIT);
+	memset(&client, 0, sizeof(client));
+	client.budget = &budget;
+	g_mutex_init(&client.lock);
+	g_cond_init(&client.queued);
+	thread = g_thread_new("release", release_slowly, &client);
+
+	for (i = 0; i < FRAMES; ++i) {
+		size_t used;
+		int timeouts = 0;
+
+		/* releases have to wake the wait long before a second passes */
+		while (mem_budget_exhausted(&budget) && timeouts < 10)
+			timeouts += !mem_budget_wait(&budget, 100 * 1000);
+		CHECK(timeouts < 10);
+
+		mem_budget_charge(&budget, FRAME_SIZE);
+		used = (size_t) metrics_get(METRIC_INFLIGHT_BYTES);
+		if (used > client.peak)
+			client.peak = used;
+
+		g_mutex_lock(&client.lock);
+		client.pushed++;
+		g_cond_signal(&client.queued);
+		g_mutex_unlock(&client.lock);
+
+		if (i % 16 == 0)
+			flushed += mem_budget_flush(&budget);
+	}
+
+	g_thread_join(thread);
+
+	/* the check comes before the charge, so one frame may overshoot */
+	CHECK(client.peak <= LIMIT + FRAME_SIZE);
+	CHECK(client.peak >= LIMIT);
+
+	/* everything came back, flush hands out the rest of the releases once */
+	CHECK_EQ(budget.used, 0);
+	CHECK_EQ(metrics_get(METRIC_INFLIGHT_BYTES), 0);
+	flushed += mem_budget_flush(&budget);
+	CHECK_EQ(flushed, FRAMES);
+	CHECK_EQ(mem_budget_flush(&budget), 0);
+	CHECK(!mem_budget_exhausted(&budget));
+
+	g_mutex_clear(&client.lock);
+	g_cond_clear(&client.queued);
+}
+
+static void test_wait_timeout(void)
+{
+	struct mem_budget budget;
+	gint64 start;
+
+	mem_budget_init(&budget, 100);
+	CHECK(mem_budget_wait(&budget, 0));
+	mem_budget_charge(&budget, 100);
+	CHECK(mem_budget_exhausted(&budget));
+
+	/* nobody releases anything */
+	start = g_get_monotonic_time();
+	CHECK(!mem_budget_wait(&budget, 20 * 1000));
+	CHECK(g_get_monotonic_time() - start >= 20 * 1000);
+
+	mem_budget_release(&budget, 1);
+	CHECK(!mem_budget_exhausted(&budget));
+	CHECK(mem_budget_wait(&budget, 0));
+	CHECK_EQ(mem_budget_flush(&budget), 1);
+}
+
+static void test_unlimited(void)
+{
+	struct mem_budget budget;
+
+	mem_budget_init(&budget, 0);
+	mem_budget_charge(&budget, (size_t) -1 / 2);
+	CHECK(!mem_budget_exhausted(&budget));
+	CHECK(mem_budget_wait(&budget, 0));
+}
+
+int main(void)
+{
+	test_slow_release();
+	test_wait_timeout();
+	test_unlimited();
+
+	return test_result();
+}
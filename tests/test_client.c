@@ -0,0 +1,164 @@
+#include <spice/protocol.h>
+#include <spice/qxl_dev.h>
+#include <string.h>
+
+#include "client.h"
+#include "cursor_qxl.h"
+#include "cursor_shape.h"
+#include "test.h"
+
+/* at least the SPICE_CAPABILITIES_SIZE bytes spice hands over */
+#define CAPS_SIZE 64
+
+static void set_cap(uint8_t *caps, int cap)
+{
+	caps[cap / 8] |= 1 << (cap % 8);
+}
+
+static void test_codecs_parse(void)
+{
+	CHECK_EQ(client_codecs_parse(NULL), CLIENT_CODEC_MJPEG);
+	CHECK_EQ(client_codecs_parse(""), 0);
+	CHECK_EQ(client_codecs_parse("gstreamer:h264;gstreamer:vp8;spice:mjpeg"),
+			 CLIENT_CODEC_H264 | CLIENT_CODEC_VP8 | CLIENT_CODEC_MJPEG);
+	CHECK_EQ(client_codecs_parse("gstreamer:vp9;"), CLIENT_CODEC_VP9);
+	CHECK_EQ(client_codecs_parse("gstreamer:h265"), CLIENT_CODEC_H265);
+
+	/* names have to match whole, entries need an encoder */
+	CHECK_EQ(client_codecs_parse("gstreamer:h26"), 0);
+	CHECK_EQ(client_codecs_parse("gstreamer:h2640"), 0);
+	CHECK_EQ(client_codecs_parse("vp8;spice:mjpeg"), CLIENT_CODEC_MJPEG);
+}
+
+static void test_caps_parse(void)
+{
+	uint8_t caps[CAPS_SIZE];
+	struct client_caps client;
+
+	/* an old client without codec negotiation */
+	memset(caps, 0, sizeof(caps));
+	client_caps_parse(&client, 1, caps);
+	CHECK_EQ(client.present, 1);
+	CHECK_EQ(client.codecs, CLIENT_CODEC_MJPEG);
+	CHECK_EQ(client.lz4, 0);
+	CHECK_EQ(client.monitors_config, 0);
+
+	/* the codec bits only count with negotiation */
+	set_cap(caps, SPICE_DISPLAY_CAP_CODEC_H264);
+	client_caps_parse(&client, 1, caps);
+	CHECK_EQ(client.codecs, CLIENT_CODEC_MJPEG);
+
+	set_cap(caps, SPICE_DISPLAY_CAP_MULTI_CODEC);
+	set_cap(caps, SPICE_DISPLAY_CAP_CODEC_VP9);
+	set_cap(caps, SPICE_DISPLAY_CAP_LZ4_COMPRESSION);
+	set_cap(caps, SPICE_DISPLAY_CAP_MONITORS_CONFIG);
+	client_caps_parse(&client, 1, caps);
+	CHECK_EQ(client.codecs, CLIENT_CODEC_H264 | CLIENT_CODEC_VP9);
+	CHECK_EQ(client.lz4, 1);
+	CHECK_EQ(client.monitors_config, 1);
+}
+
+static void test_headless(void)
+{
+	uint8_t caps[CAPS_SIZE];
+	struct client_caps client;
+
+	/* the last client left, whatever its caps said is gone */
+	memset(caps, 0xff, sizeof(caps));
+	client_caps_parse(&client, 0, caps);
+	CHECK_EQ(client.present, 0);
+	CHECK_EQ(client.codecs, 0);
+	CHECK_EQ(client.lz4, 0);
+	CHECK_EQ(client.monitors_config, 0);
+
+	/* tracking stays on for the next client */
+	CHECK(client_can_stream(&client, CLIENT_CODEC_H264));
+}
+
+static void test_can_stream(void)
+{
+	uint8_t caps[CAPS_SIZE];
+	struct client_caps client;
+
+	memset(caps, 0, sizeof(caps));
+	set_cap(caps, SPICE_DISPLAY_CAP_MULTI_CODEC);
+	set_cap(caps, SPICE_DISPLAY_CAP_CODEC_VP8);
+	client_caps_parse(&client, 1, caps);
+
+	CHECK(client_can_stream(&client, client_codecs_parse("gstreamer:h264;gstreamer:vp8")));
+	CHECK(!client_can_stream(&client, client_codecs_parse("gstreamer:h264")));
+	/* spice's default list is MJPEG, which this client did not announce */
+	CHECK(!client_can_stream(&client, client_codecs_parse(NULL)));
+}
+
+/* a DXGI color cursor as the cursor channel hands it to spice */
+static QXLCursor *encode_color_cursor(const uint32_t *pixels, int width, int height, struct cursor_shape *shape)
+{
+	struct cursor_shape_info info = { CURSOR_SHAPE_MASKED_COLOR, width, height, width * 4, 2, 1 };
+	QXLCursor *cursor;
+
+	if (cursor_shape_convert(&info, (const uint8_t *) pixels, (size_t) width * height * 4, shape) < 0)
+		return NULL;
+
+	cursor = calloc(1, cursor_qxl_size(shape));
+	if (cursor)
+		cursor_qxl_fill(cursor, shape);
+
+	return cursor;
+}
+
+/*
+ * set_client_capabilities carries no cursor caps, every client gets the
+ * format the shape needs: alpha unless pixels invert the screen.
+ */
+static void test_cursor_encoding(void)
+{
+	uint32_t pixels[2][5];
+	struct cursor_shape shape;
+	QXLCursor *cursor;
+	int x, y;
+
+	/* opaque and transparent pixels only */
+	for (y = 0; y < 2; ++y)
+		for (x = 0; x < 5; ++x)
+			pixels[y][x] = x & 1 ? 0xff000000u : 0x00102030u;
+	cursor = encode_color_cursor(&pixels[0][0], 5, 2, &shape);
+	CHECK(cursor != NULL);
+	if (cursor) {
+		CHECK_EQ(cursor->header.type, SPICE_CURSOR_TYPE_ALPHA);
+		CHECK_EQ(cursor->header.width, 5);
+		CHECK_EQ(cursor->header.height, 2);
+		CHECK_EQ(cursor->header.hot_spot_x, 2);
+		CHECK_EQ(cursor->header.hot_spot_y, 1);
+		CHECK_EQ(cursor->data_size, 5 * 2 * 4);
+		CHECK_EQ(cursor->chunk.data_size, cursor->data_size);
+		CHECK_EQ(cursor->chunk.next_chunk, 0);
+		CHECK(memcmp(cursor->chunk.data, shape.data, shape.size) == 0);
+		free(cursor);
+	}
+	cursor_shape_free(&shape);
+
+	/* an inverting pixel keeps the XOR semantics of the mask */
+	pixels[1][2] = 0xffffffffu;
+	cursor = encode_color_cursor(&pixels[0][0], 5, 2, &shape);
+	CHECK(cursor != NULL);
+	if (cursor) {
+		CHECK_EQ(cursor->header.type, SPICE_CURSOR_TYPE_COLOR32);
+		/* BGRX pixels followed by the 1 bit AND mask, rows padded to bytes */
+		CHECK_EQ(cursor->data_size, 5 * 2 * 4 + 2);
+		CHECK(memcmp(cursor->chunk.data, shape.data, shape.size) == 0);
+		free(cursor);
+	}
+	cursor_shape_free(&shape);
+}
+
+int main(void)
+{
+	test_codecs_parse();
+	test_caps_parse();
+	test_headless();
+	test_can_stream();
+	test_cursor_encoding();
+
+	return test_result();
+}
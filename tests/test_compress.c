@@ -0,0 +1,92 @@
+#include "compress.h"
+#include "test.h"
+
+#define S 1000000
+
+/* one second of traffic, every drawable waited latency_ms */
+static int step(struct compress_ctl *ctl, struct compress_sample *sample, int sent, double latency_ms)
+{
+	sample->now += S;
+	sample->sent += sent;
+	sample->waited += (int64_t) (latency_ms * 1000) * sent;
+	sample->released_bytes += sent * 4096;
+	return compress_ctl_update(ctl, sample);
+}
+
+static void test_switch(void)
+{
+	struct compress_sample sample = { 0 };
+	struct compress_ctl ctl;
+	int i;
+
+	compress_ctl_init(&ctl, &sample);
+	CHECK_EQ(ctl.mode, COMPRESS_LOSSLESS);
+
+	/* slow drain, but the mode is kept for the minimum time */
+	for (i = 0; i < 4; ++i)
+		CHECK_EQ(step(&ctl, &sample, 100, 300), 0);
+	CHECK_EQ(step(&ctl, &sample, 100, 300), 1);
+	CHECK_EQ(ctl.mode, COMPRESS_LOSSY);
+	CHECK_EQ((int64_t) ctl.drain_rate, 100);
+	CHECK_EQ((int64_t) ctl.bandwidth, 409600);
+
+	/* between the thresholds nothing changes */
+	for (i = 0; i < 10; ++i)
+		CHECK_EQ(step(&ctl, &sample, 100, 80), 0);
+	CHECK_EQ(ctl.mode, COMPRESS_LOSSY);
+
+	/* fast again */
+	for (i = 0; i < 10 && !step(&ctl, &sample, 100, 5); ++i)
+		;
+	CHECK_EQ(ctl.mode, COMPRESS_LOSSLESS);
+}
+
+static void test_stuck(void)
+{
+	struct compress_sample sample = { 0 };
+	struct compress_ctl ctl;
+	int i;
+
+	compress_ctl_init(&ctl, &sample);
+	for (i = 0; i < 5; ++i)
+		step(&ctl, &sample, 100, 300);
+	CHECK_EQ(ctl.mode, COMPRESS_LOSSY);
+
+	/* nothing is sent while drawables wait, the queue is stuck, not idle */
+	for (i = 0; i < 10; ++i) {
+		sample.oldest = (i + 1) * S;
+		CHECK_EQ(step(&ctl, &sample, 0, 0), 0);
+	}
+	CHECK_EQ(ctl.mode, COMPRESS_LOSSY);
+	CHECK(ctl.latency_ms > 150);
+
+	/* idle: nothing sent and nothing queued */
+	sample.oldest = 0;
+	for (i = 0; i < 10 && !step(&ctl, &sample, 0, 0); ++i)
+		;
+	CHECK_EQ(ctl.mode, COMPRESS_LOSSLESS);
+}
+
+static void test_oldest(void)
+{
+	struct compress_sample sample = { 0 };
+	struct compress_ctl ctl;
+	int i;
+
+	/* a few quick drawables go out while a large one is stuck behind them */
+	compress_ctl_init(&ctl, &sample);
+	for (i = 0; i < 6; ++i) {
+		sample.oldest = 400 * 1000;
+		step(&ctl, &sample, 10, 5);
+	}
+	CHECK_EQ(ctl.mode, COMPRESS_LOSSY);
+}
+
+int main(void)
+{
+	test_switch();
+	test_stuck();
+	test_oldest();
+
+	return test_result();
+}
@@ -0,0 +1,266 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "cursor_shape.h"
+#include "test.h"
+
+static uint32_t pixel_at(const struct cursor_shape *shape, int x, int y)
+{
+	uint32_t p;
+
+	memcpy(&p, shape->data + ((size_t) y * shape->width + x) * 4, sizeof(p));
+
+	return p;
+}
+
+static int mask_bit(const uint8_t *mask, int stride, int x, int y)
+{
+	return (mask[y * stride + x / 8] >> (7 - (x & 7))) & 1;
+}
+
+/*
+ * Monochrome shape as DXGI reports it: AND mask rows followed by XOR mask
+ * rows, pitch may be larger than needed. In rows 'a' sets the AND bit,
+ * 'x' the XOR bit and 'i' both.
+ */
+static uint8_t *mono_shape(struct cursor_shape_info *info, const char *const *rows, int width, int height, int pitch)
+{
+	uint8_t *buf = calloc((size_t) pitch * height * 2, 1);
+	int x, y;
+
+	for (y = 0; y < height; ++y) {
+		for (x = 0; x < width; ++x) {
+			uint8_t bit = 0x80 >> (x & 7);
+
+			if (rows[y][x] == 'a' || rows[y][x] == 'i')
+				buf[y * pitch + x / 8] |= bit;
+			if (rows[y][x] == 'x' || rows[y][x] == 'i')
+				buf[(height + y) * pitch + x / 8] |= bit;
+		}
+	}
+
+	info->type = CURSOR_SHAPE_MONOCHROME;
+	info->width = width;
+	info->height = height * 2;
+	info->pitch = pitch;
+	info->hot_x = 1;
+	info->hot_y = 2;
+
+	return buf;
+}
+
+/* an arrow: transparent, black outline, white fill and a 13 pixel wide row for the scalar tail */
+static void test_mono_alpha(void)
+{
+	static const char *const rows[] = {
+		"...aaaaaaaaaa",
+		"a............",
+		"ax...........",
+		"axxaaaaaaaaaa",
+	};
+	struct cursor_shape_info info;
+	struct cursor_shape shape;
+	uint8_t *buf = mono_shape(&info, rows, 13, 4, 4);
+	int x, y;
+
+	CHECK_EQ(cursor_shape_convert(&info, buf, (size_t) info.pitch * info.height, &shape), 0);
+	CHECK_EQ(shape.format, CURSOR_FORMAT_ALPHA);
+	CHECK_EQ(shape.width, 13);
+	CHECK_EQ(shape.height, 4);
+	CHECK_EQ(shape.hot_x, 1);
+	CHECK_EQ(shape.hot_y, 2);
+
+	for (y = 0; y < 4; ++y) {
+		for (x = 0; x < 13; ++x) {
+			uint32_t expected = rows[y][x] == 'a' ? 0 : rows[y][x] == 'x' ? 0xffffffff : 0xff000000;
+
+			CHECK_EQ(pixel_at(&shape, x, y), expected);
+		}
+	}
+
+	cursor_shape_free(&shape);
+	free(buf);
+}
+
+/* the I-beam inverts the screen, the masks are kept with the pitch removed */
+static void test_mono_invert(void)
+{
+	static const char *const rows[] = {
+		"aaaiiiiiaaa",
+		"aaaaaiaaaaa",
+		"aaaaaiaaaaa",
+		"aaaiiiiiaaa",
+	};
+	struct cursor_shape_info info;
+	struct cursor_shape shape;
+	uint8_t *buf = mono_shape(&info, rows, 11, 4, 6);
+	int stride = 2;
+	int x, y;
+
+	CHECK_EQ(cursor_shape_convert(&info, buf, (size_t) info.pitch * info.height, &shape), 0);
+	CHECK_EQ(shape.format, CURSOR_FORMAT_MONO);
+	CHECK_EQ(shape.width, 11);
+	CHECK_EQ(shape.height, 4);
+	CHECK_EQ(shape.size, stride * 4 * 2);
+
+	for (y = 0; y < 4; ++y) {
+		for (x = 0; x < 11; ++x) {
+			CHECK_EQ(mask_bit(shape.data, stride, x, y), rows[y][x] == 'a' || rows[y][x] == 'i');
+			CHECK_EQ(mask_bit(shape.data + stride * 4, stride, x, y), rows[y][x] == 'x' || rows[y][x] == 'i');
+		}
+	}
+
+	cursor_shape_free(&shape);
+	free(buf);
+}
+
+static void test_color(void)
+{
+	uint32_t buf[3][6];	/* 5 pixels and padding per row */
+	struct cursor_shape_info info = { CURSOR_SHAPE_COLOR, 5, 3, sizeof(buf[0]), 0, 0 };
+	struct cursor_shape shape;
+	int x, y;
+
+	for (y = 0; y < 3; ++y)
+		for (x = 0; x < 6; ++x)
+			buf[y][x] = (uint32_t) (x * 0x40) << 24 | (uint32_t) (y * 0x10101);
+
+	CHECK_EQ(cursor_shape_convert(&info, (const uint8_t *) buf, sizeof(buf), &shape), 0);
+	CHECK_EQ(shape.format, CURSOR_FORMAT_ALPHA);
+	CHECK_EQ(shape.size, 5 * 3 * 4);
+	for (y = 0; y < 3; ++y)
+		for (x = 0; x < 5; ++x)
+			CHECK_EQ(pixel_at(&shape, x, y), buf[y][x]);
+
+	cursor_shape_free(&shape);
+}
+
+/*
+ * Masked color: alpha 0 replaces the screen, alpha 0xff XORs the color,
+ * XOR with black leaves the screen alone.
+ */
+static void test_masked_color_alpha(void)
+{
+	uint32_t buf[2][7];
+	struct cursor_shape_info info = { CURSOR_SHAPE_MASKED_COLOR, 7, 2, sizeof(buf[0]), 3, 4 };
+	struct cursor_shape shape;
+	int x, y;
+
+	for (y = 0; y < 2; ++y)
+		for (x = 0; x < 7; ++x)
+			buf[y][x] = (x + y) & 1 ? 0xff000000 : 0x00123456u + x;
+
+	CHECK_EQ(cursor_shape_convert(&info, (const uint8_t *) buf, sizeof(buf), &shape), 0);
+	CHECK_EQ(shape.format, CURSOR_FORMAT_ALPHA);
+	for (y = 0; y < 2; ++y)
+		for (x = 0; x < 7; ++x)
+			CHECK_EQ(pixel_at(&shape, x, y), (x + y) & 1 ? 0 : 0xff123456 + x);
+
+	cursor_shape_free(&shape);
+}
+
+static void test_masked_color_xor(void)
+{
+	uint32_t buf[2][9];
+	struct cursor_shape_info info = { CURSOR_SHAPE_MASKED_COLOR, 9, 2, sizeof(buf[0]), 0, 0 };
+	struct cursor_shape shape;
+	const uint8_t *mask;
+	int stride = 2;
+	int x, y;
+
+	/* an inverting column at x 8 only shows up in the scalar tail */
+	for (y = 0; y < 2; ++y)
+		for (x = 0; x < 9; ++x)
+			buf[y][x] = x == 8 ? 0xffffffff : 0x00203040;
+
+	CHECK_EQ(cursor_shape_convert(&info, (const uint8_t *) buf, sizeof(buf), &shape), 0);
+	CHECK_EQ(shape.format, CURSOR_FORMAT_COLOR32);
+	CHECK_EQ(shape.size, 9 * 2 * 4 + stride * 2);
+
+	mask = shape.data + 9 * 2 * 4;
+	for (y = 0; y < 2; ++y) {
+		for (x = 0; x < 9; ++x) {
+			CHECK_EQ(pixel_at(&shape, x, y), x == 8 ? 0x00ffffff : 0x00203040);
+			CHECK_EQ(mask_bit(mask, stride, x, y), x == 8);
+		}
+	}
+
+	cursor_shape_free(&shape);
+}
+
+static void test_invalid(void)
+{
+	uint8_t buf[64] = { 0 };
+	struct cursor_shape_info info = { CURSOR_SHAPE_COLOR, 4, 4, 16, 0, 0 };
+	struct cursor_shape shape;
+
+	/* the buffer is smaller than pitch * height */
+	CHECK_EQ(cursor_shape_convert(&info, buf, 32, &shape), -1);
+
+	info.pitch = 8;
+	CHECK_EQ(cursor_shape_convert(&info, buf, sizeof(buf), &shape), -1);
+
+	info.type = CURSOR_SHAPE_MONOCHROME;
+	info.height = 1;
+	CHECK_EQ(cursor_shape_convert(&info, buf, sizeof(buf), &shape), -1);
+
+	info.type = 3;
+	info.height = 4;
+	CHECK_EQ(cursor_shape_convert(&info, buf, sizeof(buf), &shape), -1);
+
+	info.type = CURSOR_SHAPE_COLOR;
+	info.width = 0;
+	CHECK_EQ(cursor_shape_convert(&info, buf, sizeof(buf), &shape), -1);
+}
+
+static void test_cache(void)
+{
+	struct cursor_cache cache;
+	uint32_t buf[CURSOR_CACHE_SIZE + 1][4];
+	struct cursor_shape_info info = { CURSOR_SHAPE_COLOR, 2, 2, 8, 0, 0 };
+	const struct cursor_shape *first, *shape;
+	int i;
+
+	cursor_cache_init(&cache);
+	for (i = 0; i <= CURSOR_CACHE_SIZE; ++i)
+		memset(buf[i], i, sizeof(buf[i]));
+
+	first = cursor_cache_get(&cache, 1, &info, (const uint8_t *) buf[0], sizeof(buf[0]));
+	CHECK(first != NULL);
+	CHECK_EQ(first->hash, 1);
+	/* a hit returns the converted shape without looking at the buffer */
+	CHECK(cursor_cache_get(&cache, 1, &info, NULL, 0) == first);
+
+	/* fill the cache, shape 1 is used again so shape 2 is the oldest */
+	for (i = 2; i <= CURSOR_CACHE_SIZE; ++i)
+		CHECK(cursor_cache_get(&cache, i, &info, (const uint8_t *) buf[i - 1], sizeof(buf[i - 1])) != NULL);
+	CHECK(cursor_cache_get(&cache, 1, &info, NULL, 0) == first);
+
+	shape = cursor_cache_get(&cache, CURSOR_CACHE_SIZE + 1, &info, (const uint8_t *) buf[CURSOR_CACHE_SIZE],
+							 sizeof(buf[CURSOR_CACHE_SIZE]));
+	CHECK(shape != NULL);
+	CHECK(cursor_cache_get(&cache, 1, &info, NULL, 0) == first);
+	for (i = 0; i < CURSOR_CACHE_SIZE; ++i)
+		CHECK(cache.shapes[i].hash != 2);
+
+	/* a shape that fails to convert is not cached */
+	info.width = 0;
+	CHECK(cursor_cache_get(&cache, 99, &info, (const uint8_t *) buf[0], sizeof(buf[0])) == NULL);
+	info.width = 2;
+	CHECK(cursor_cache_get(&cache, 99, &info, (const uint8_t *) buf[0], sizeof(buf[0])) != NULL);
+
+	cursor_cache_cleanup(&cache);
+}
+
+int main(void)
+{
+	test_mono_alpha();
+	test_mono_invert();
+	test_color();
+	test_masked_color_alpha();
+	test_masked_color_xor();
+	test_invalid();
+	test_cache();
+
+	return test_result();
+}
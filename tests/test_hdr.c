@@ -0,0 +1,100 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "hdr.h"
+#include "test.h"
+
+#define HALF_ZERO 0x0000
+#define HALF_HALF 0x3800
+#define HALF_ONE 0x3c00
+#define HALF_THREE 0x4200
+#define HALF_FOUR 0x4400
+#define HALF_MINUS_ONE 0xbc00
+#define HALF_INF 0x7c00
+#define HALF_NAN 0x7e00
+
+/* R16G16B16A16 pixel */
+static void set_pixel(uint16_t *p, uint16_t r, uint16_t g, uint16_t b)
+{
+	p[0] = r;
+	p[1] = g;
+	p[2] = b;
+	p[3] = HALF_ONE;
+}
+
+static uint32_t convert_one(const struct tonemap *tonemap, uint16_t r, uint16_t g, uint16_t b)
+{
+	uint16_t src[4];
+	uint32_t dst;
+
+	set_pixel(src, r, g, b);
+	tonemap_copy(tonemap, (const uint8_t *) src, sizeof(src), 1, 1, (uint8_t *) &dst, sizeof(dst));
+
+	return dst;
+}
+
+static void test_sdr_white(void)
+{
+	struct tonemap tonemap;
+
+	/* 1.0 is SDR white at the default level, it must stay full white */
+	tonemap_init(&tonemap, HDR_SCRGB_WHITE_NITS);
+	CHECK_EQ(convert_one(&tonemap, HALF_ONE, HALF_ONE, HALF_ONE), 0xffffffff);
+	CHECK_EQ(convert_one(&tonemap, HALF_ZERO, HALF_ZERO, HALF_ZERO), 0xff000000);
+	/* linear 0.5 is sRGB 188 */
+	CHECK_EQ(convert_one(&tonemap, HALF_HALF, HALF_HALF, HALF_HALF), 0xffbcbcbc);
+
+	/* at 240 nits SDR white is 3.0 in scRGB */
+	tonemap_init(&tonemap, 3 * HDR_SCRGB_WHITE_NITS);
+	CHECK_EQ(convert_one(&tonemap, HALF_THREE, HALF_THREE, HALF_THREE), 0xffffffff);
+	CHECK_EQ(convert_one(&tonemap, HALF_FOUR, HALF_ONE, HALF_ZERO), 0xffff9c00);
+}
+
+static void test_out_of_range(void)
+{
+	struct tonemap tonemap;
+
+	tonemap_init(&tonemap, HDR_SCRGB_WHITE_NITS);
+	/* channel order is BGRX */
+	CHECK_EQ(convert_one(&tonemap, HALF_FOUR, HALF_MINUS_ONE, HALF_ZERO), 0xffff0000);
+	CHECK_EQ(convert_one(&tonemap, HALF_INF, HALF_NAN, HALF_ZERO), 0xffff0000);
+	CHECK_EQ(convert_one(&tonemap, HALF_ZERO, HALF_ZERO, HALF_INF), 0xff0000ff);
+}
+
+/* rows of odd width cover the single pixel tail, strides are larger than the rows */
+static void test_rows(void)
+{
+	static const uint16_t values[] = { HALF_ZERO, HALF_HALF, HALF_ONE, HALF_FOUR };
+	static const uint8_t expected[] = { 0x00, 0xbc, 0xff, 0xff };
+	struct tonemap tonemap;
+	uint16_t src[3][8 * 4];
+	uint32_t dst[3][8];
+	int width, x, y;
+
+	tonemap_init(&tonemap, HDR_SCRGB_WHITE_NITS);
+	for (width = 1; width <= 7; ++width) {
+		for (y = 0; y < 3; ++y)
+			for (x = 0; x < width; ++x)
+				set_pixel(&src[y][x * 4], values[(x + y) & 3], values[(x + y + 1) & 3], values[(x + y + 2) & 3]);
+		memset(dst, 0, sizeof(dst));
+
+		tonemap_copy(&tonemap, (const uint8_t *) src, sizeof(src[0]), width, 3, (uint8_t *) dst, sizeof(dst[0]));
+
+		for (y = 0; y < 3; ++y) {
+			for (x = 0; x < width; ++x)
+				CHECK_EQ(dst[y][x], 0xff000000u | expected[(x + y) & 3] << 16 |
+						 expected[(x + y + 1) & 3] << 8 | expected[(x + y + 2) & 3]);
+			for (; x < 8; ++x)
+				CHECK_EQ(dst[y][x], 0);
+		}
+	}
+}
+
+int main(void)
+{
+	test_sdr_white();
+	test_out_of_range();
+	test_rows();
+
+	return test_result();
+}
@@ -0,0 +1,75 @@
+#include "idle.h"
+#include "test.h"
+
+#define MS 1000
+
+static void test_initial(void)
+{
+	struct idle_policy idle;
+
+	/* nothing happened yet, the long timeout saves wakeups */
+	idle_policy_init(&idle, 16, 1000, 500);
+	CHECK_EQ(idle_policy_timeout(&idle, 10000 * MS), 1000);
+
+	/* max below min is raised to min */
+	idle_policy_init(&idle, 16, 8, 500);
+	CHECK_EQ(idle.max_ms, 16);
+	CHECK_EQ(idle_policy_timeout(&idle, 10000 * MS), 16);
+}
+
+static void test_backoff(void)
+{
+	static const int expected[] = { 32, 64, 128, 256, 512, 1000, 1000 };
+	struct idle_policy idle;
+	int64_t now = 10000 * MS;
+	size_t i;
+
+	idle_policy_init(&idle, 16, 1000, 500);
+	idle_policy_activity(&idle, now);
+
+	/* short while activity is recent */
+	CHECK_EQ(idle_policy_timeout(&idle, now), 16);
+	CHECK_EQ(idle_policy_timeout(&idle, now + 499 * MS), 16);
+
+	/* then doubles per wait and stays at max */
+	now += 500 * MS;
+	for (i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+		int timeout = idle_policy_timeout(&idle, now);
+
+		CHECK_EQ(timeout, expected[i]);
+		now += timeout * MS;
+	}
+}
+
+static void test_activity_resets(void)
+{
+	struct idle_policy idle;
+	int64_t now = 10000 * MS;
+	int i;
+
+	idle_policy_init(&idle, 16, 1000, 500);
+	for (i = 0; i < 10; ++i)
+		idle_policy_timeout(&idle, now + i * 1000 * MS);
+	CHECK_EQ(idle.timeout_ms, 1000);
+
+	/* a frame or input event drops straight back to min */
+	now += 20000 * MS;
+	idle_policy_activity(&idle, now);
+	CHECK_EQ(idle.timeout_ms, 16);
+	CHECK_EQ(idle_policy_timeout(&idle, now + 100 * MS), 16);
+	CHECK_EQ(idle_policy_timeout(&idle, now + 600 * MS), 32);
+
+	/* activity during the backoff restarts the active window */
+	idle_policy_activity(&idle, now + 700 * MS);
+	CHECK_EQ(idle_policy_timeout(&idle, now + 1100 * MS), 16);
+	CHECK_EQ(idle_policy_timeout(&idle, now + 1200 * MS), 32);
+}
+
+int main(void)
+{
+	test_initial();
+	test_backoff();
+	test_activity_resets();
+
+	return test_result();
+}
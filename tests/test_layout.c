@@ -0,0 +1,284 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "layout.h"
+#include "scale.h"
+#include "test.h"
+
+/* a primary in the middle, one output left of it and one above right */
+static const struct layout_output three[] = {
+	{ 0, { 0, 0, 1920, 1080 }, { 0, 0, 0, 0 } },
+	{ 1, { 1920, -200, 3200, 824 }, { 0, 0, 0, 0 } },
+	{ 2, { -1280, 0, 0, 1024 }, { 0, 0, 0, 0 } },
+};
+
+static void test_origin(void)
+{
+	struct layout layout;
+	int x = 0, y = 0;
+
+	CHECK_EQ(layout_init(&layout, three, 3, 0, 0), 0);
+	CHECK_EQ(layout.count, 3);
+
+	/* the surface starts at the top left of the bounding box */
+	CHECK_EQ(layout.desktop.left, -1280);
+	CHECK_EQ(layout.desktop.top, -200);
+	CHECK_EQ(layout.width, 1280 + 1920 + 1280);
+	CHECK_EQ(layout.height, 1280);
+	CHECK_EQ(layout.outputs[2].surface.left, 0);
+	CHECK_EQ(layout.outputs[2].surface.top, 200);
+	CHECK_EQ(layout.outputs[0].surface.left, 1280);
+	CHECK_EQ(layout.outputs[0].surface.top, 200);
+	CHECK_EQ(layout.outputs[1].surface.top, 0);
+
+	/* the desktop origin is the top left of the primary */
+	layout_point_to_surface(&layout, &x, &y);
+	CHECK_EQ(x, 1280);
+	CHECK_EQ(y, 200);
+}
+
+static void test_adjacent(void)
+{
+	static const int sizes[][2] = { { 2240, 640 }, { 1999, 701 }, { 6000, 1700 }, { 333, 97 } };
+	struct layout layout;
+	size_t i;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		const struct rect *primary, *right, *left;
+
+		CHECK_EQ(layout_init(&layout, three, 3, sizes[i][0], sizes[i][1]), 0);
+		CHECK_EQ(layout.width, sizes[i][0]);
+		CHECK_EQ(layout.height, sizes[i][1]);
+
+		primary = &layout.outputs[0].surface;
+		right = &layout.outputs[1].surface;
+		left = &layout.outputs[2].surface;
+
+		/* no gap and no overlap where the desktops touch */
+		CHECK_EQ(left->right, primary->left);
+		CHECK_EQ(primary->right, right->left);
+		CHECK_EQ(left->top, primary->top);
+
+		/* the heads fill the surface */
+		CHECK_EQ(left->left, 0);
+		CHECK_EQ(right->right, sizes[i][0]);
+		CHECK_EQ(right->top, 0);
+		CHECK(primary->bottom <= sizes[i][1]);
+	}
+}
+
+static void test_reject(void)
+{
+	struct layout_output outputs[LAYOUT_MAX_OUTPUTS + 1];
+	struct layout layout;
+	int i;
+
+	CHECK(layout_init(&layout, three, 0, 0, 0) < 0);
+	CHECK_EQ(layout.count, 0);
+
+	for (i = 0; i < LAYOUT_MAX_OUTPUTS + 1; ++i)
+		outputs[i] = (struct layout_output) { i, { i * 100, 0, (i + 1) * 100, 100 }, { 0, 0, 0, 0 } };
+	CHECK(layout_init(&layout, outputs, LAYOUT_MAX_OUTPUTS + 1, 0, 0) < 0);
+	CHECK_EQ(layout_init(&layout, outputs, LAYOUT_MAX_OUTPUTS, 0, 0), 0);
+
+	/* an output without pixels */
+	outputs[1].desktop.right = outputs[1].desktop.left;
+	CHECK(layout_init(&layout, outputs, 2, 0, 0) < 0);
+	CHECK_EQ(layout.count, 0);
+
+	/* an output scaled down to nothing */
+	outputs[0] = (struct layout_output) { 0, { 0, 0, 4000, 100 }, { 0, 0, 0, 0 } };
+	outputs[1] = (struct layout_output) { 1, { 4000, 0, 4001, 100 }, { 0, 0, 0, 0 } };
+	outputs[2] = (struct layout_output) { 2, { 4001, 0, 8000, 100 }, { 0, 0, 0, 0 } };
+	CHECK_EQ(layout_init(&layout, outputs, 3, 0, 0), 0);
+	CHECK(layout_init(&layout, outputs, 3, 1000, 100) < 0);
+}
+
+static void test_round_trip(void)
+{
+	struct layout layout;
+	int x, y, sx, sy;
+
+	/* unscaled, every point maps back exactly */
+	CHECK_EQ(layout_init(&layout, three, 3, 0, 0), 0);
+	for (y = -200; y < 1080; y += 37) {
+		for (x = -1280; x < 3200; x += 41) {
+			sx = x;
+			sy = y;
+			layout_point_to_surface(&layout, &sx, &sy);
+			CHECK(sx >= 0 && sx < layout.width && sy >= 0 && sy < layout.height);
+			layout_point_to_desktop(&layout, &sx, &sy);
+			CHECK_EQ(sx, x);
+			CHECK_EQ(sy, y);
+		}
+	}
+
+	/* scaled up, desktop points come back */
+	CHECK_EQ(layout_init(&layout, three, 3, 2 * 4480, 2 * 1280), 0);
+	for (y = -200; y < 1080; y += 37) {
+		for (x = -1280; x < 3200; x += 41) {
+			sx = x;
+			sy = y;
+			layout_point_to_surface(&layout, &sx, &sy);
+			layout_point_to_desktop(&layout, &sx, &sy);
+			CHECK_EQ(sx, x);
+			CHECK_EQ(sy, y);
+		}
+	}
+
+	/* scaled down, surface points come back, the pointer stays where the client put it */
+	CHECK_EQ(layout_init(&layout, three, 3, 1999, 701), 0);
+	for (y = 0; y < layout.height; y += 13) {
+		for (x = 0; x < layout.width; x += 17) {
+			sx = x;
+			sy = y;
+			layout_point_to_desktop(&layout, &sx, &sy);
+			layout_point_to_surface(&layout, &sx, &sy);
+			CHECK_EQ(sx, x);
+			CHECK_EQ(sy, y);
+		}
+	}
+}
+
+static void test_equal(void)
+{
+	struct layout_output moved[3];
+	struct layout a, b;
+
+	CHECK_EQ(layout_init(&a, three, 3, 0, 0), 0);
+	CHECK_EQ(layout_init(&b, three, 3, 0, 0), 0);
+	CHECK(layout_equal(&a, &b));
+
+	/* the same outputs scaled, as after a --scale change */
+	CHECK_EQ(layout_init(&b, three, 3, 2240, 640), 0);
+	CHECK(!layout_equal(&a, &b));
+
+	/* an output unplugged */
+	CHECK_EQ(layout_init(&b, three, 2, 0, 0), 0);
+	CHECK(!layout_equal(&a, &b));
+
+	/* the left output moved below, same bounding box size */
+	memcpy(moved, three, sizeof(moved));
+	moved[2].desktop = (struct rect) { -1280, 56, 0, 1080 };
+	CHECK_EQ(layout_init(&b, moved, 3, 0, 0), 0);
+	CHECK_EQ(b.width, a.width);
+	CHECK_EQ(b.height, a.height);
+	CHECK(!layout_equal(&a, &b));
+
+	/* outputs renumbered */
+	memcpy(moved, three, sizeof(moved));
+	moved[0].id = 3;
+	CHECK_EQ(layout_init(&b, moved, 3, 0, 0), 0);
+	CHECK(!layout_equal(&a, &b));
+}
+
+#define TILE 16
+
+/*
+ * Two outputs of different sizes with a solid color each, captured the way
+ * display.cpp does it: a scaler per output from its desktop to its surface
+ * area, dirty tiles mapped, scaled and placed at the output's surface
+ * offset on the primary surface.
+ */
+static void test_two_outputs(int width, int height, enum scale_filter filter)
+{
+	static const struct layout_output outputs[] = {
+		{ 0, { 0, 0, 64, 48 }, { 0, 0, 0, 0 } },
+		{ 1, { 64, -8, 104, 24 }, { 0, 0, 0, 0 } },
+	};
+	static const uint32_t colors[] = { 0xff2040c0u, 0xff10e060u };
+	struct layout layout;
+	uint32_t *surface;
+	int i, x, y;
+
+	CHECK_EQ(layout_init(&layout, outputs, 2, width, height), 0);
+	surface = calloc((size_t) layout.width * layout.height, sizeof(*surface));
+
+	for (i = 0; i < 2; ++i) {
+		const struct layout_output *output = &layout.outputs[i];
+		int output_width = rect_width(&output->desktop), output_height = rect_height(&output->desktop);
+		uint32_t *pixels = malloc((size_t) output_width * output_height * sizeof(*pixels));
+		struct scaler scaler;
+		struct rect dirty;
+
+		for (y = 0; y < output_width * output_height; ++y)
+			pixels[y] = colors[i];
+
+		CHECK_EQ(scaler_init(&scaler, output_width, output_height, rect_width(&output->surface),
+							 rect_height(&output->surface), filter), 0);
+
+		/* the output in tiles, as DXGI reports dirty rects */
+		for (dirty.top = 0; dirty.top < output_height; dirty.top += TILE) {
+			for (dirty.left = 0; dirty.left < output_width; dirty.left += TILE) {
+				struct rect dst, src;
+				int row;
+
+				dirty.right = dirty.left + TILE < output_width ? dirty.left + TILE : output_width;
+				dirty.bottom = dirty.top + TILE < output_height ? dirty.top + TILE : output_height;
+				scaler_map_rect(&scaler, &dirty, &dst, &src);
+				if (rect_is_empty(&dst))
+					continue;
+				CHECK(src.left >= 0 && src.top >= 0 && src.right <= output_width && src.bottom <= output_height);
+
+				CHECK(dst.left >= 0 && dst.right <= rect_width(&output->surface));
+				CHECK(dst.top >= 0 && dst.bottom <= rect_height(&output->surface));
+
+				if (scaler_is_identity(&scaler)) {
+					for (row = src.top; row < src.bottom; ++row)
+						memcpy(surface + (size_t) (output->surface.top + row) * layout.width +
+								   output->surface.left + src.left,
+							   pixels + (size_t) row * output_width + src.left, rect_width(&src) * 4);
+				} else {
+					scaler_scale(&scaler, &dst,
+								 (uint8_t *) (surface + (size_t) (output->surface.top + dst.top) * layout.width +
+											  output->surface.left + dst.left),
+								 layout.width * 4, &src,
+								 (const uint8_t *) (pixels + (size_t) src.top * output_width + src.left),
+								 output_width * 4);
+				}
+			}
+		}
+
+		scaler_cleanup(&scaler);
+		free(pixels);
+	}
+
+	/* every head is filled with its output, the rest of the bounding box stays black */
+	for (y = 0; y < layout.height; ++y) {
+		for (x = 0; x < layout.width; ++x) {
+			uint32_t expected = 0;
+
+			for (i = 0; i < 2; ++i) {
+				const struct rect *s = &layout.outputs[i].surface;
+
+				if (x >= s->left && x < s->right && y >= s->top && y < s->bottom)
+					expected = colors[i];
+			}
+			CHECK_EQ(surface[(size_t) y * layout.width + x], expected);
+		}
+	}
+
+	/* the pointer on the second output lands on its head */
+	x = 80;
+	y = 0;
+	layout_point_to_surface(&layout, &x, &y);
+	CHECK(x >= layout.outputs[1].surface.left && x < layout.outputs[1].surface.right);
+	CHECK(y >= layout.outputs[1].surface.top && y < layout.outputs[1].surface.bottom);
+
+	free(surface);
+}
+
+int main(void)
+{
+	test_origin();
+	test_adjacent();
+	test_reject();
+	test_round_trip();
+	test_equal();
+	test_two_outputs(0, 0, SCALE_FILTER_BOX);
+	test_two_outputs(73, 37, SCALE_FILTER_BOX);
+	test_two_outputs(73, 37, SCALE_FILTER_BILINEAR);
+	test_two_outputs(208, 112, SCALE_FILTER_BILINEAR);
+
+	return test_result();
+}
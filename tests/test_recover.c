@@ -0,0 +1,187 @@
+#include <string.h>
+
+#include "recover.h"
+#include "test.h"
+
+#define S 1000000
+
+static void test_backoff(void)
+{
+	static const int64_t expected[] = {
+		50000, 100000, 200000, 400000, 800000, 1600000, 3200000, RECOVERY_MAX_US, RECOVERY_MAX_US,
+	};
+	struct recovery recovery;
+	int64_t now = 100 * S;
+	size_t i;
+
+	recovery_init(&recovery);
+	CHECK_EQ(recovery_succeeded(&recovery, now), -1);
+
+	/* lost right after it started, then no duplication can be created */
+	now += S;
+	CHECK_EQ(recovery_failed(&recovery, now, 1), RECOVERY_MIN_US);
+	for (i = 1; i < sizeof(expected) / sizeof(expected[0]); ++i)
+		CHECK_EQ(recovery_failed(&recovery, now + i * S, 0), expected[i]);
+
+	/* the time since the loss */
+	CHECK_EQ(recovery_succeeded(&recovery, now + 20 * S), 20 * S);
+	CHECK_EQ(recovery_succeeded(&recovery, now + 21 * S), -1);
+}
+
+static void test_stable(void)
+{
+	struct recovery recovery;
+	int64_t now = 100 * S;
+	int i;
+
+	recovery_init(&recovery);
+	recovery_succeeded(&recovery, now);
+
+	/* a few quick losses back off */
+	for (i = 0; i < 4; ++i) {
+		now += S / 2;
+		recovery_failed(&recovery, now, 1);
+		recovery_succeeded(&recovery, now);
+	}
+	CHECK_EQ(recovery.failures, 4);
+
+	/* a loss after a stable run is retried at once and starts over */
+	now += RECOVERY_STABLE_US;
+	CHECK_EQ(recovery_failed(&recovery, now, 1), 0);
+	CHECK_EQ(recovery.failures, 0);
+	CHECK_EQ(recovery_failed(&recovery, now + S, 0), RECOVERY_MIN_US);
+	CHECK_EQ(recovery_failed(&recovery, now + 2 * S, 0), 2 * RECOVERY_MIN_US);
+}
+
+static void test_stable_init_failure(void)
+{
+	struct recovery recovery;
+	int64_t now = 100 * S;
+	int i;
+
+	recovery_init(&recovery);
+	recovery_succeeded(&recovery, now);
+	for (i = 0; i < 10; ++i) {
+		now += S / 2;
+		recovery_failed(&recovery, now, 1);
+		recovery_succeeded(&recovery, now);
+	}
+	CHECK_EQ(recovery.failures, 10);
+
+	/*
+	 * Long stable, then the restart was not a loss, the new duplication
+	 * failed. The failures before the stable run are history.
+	 */
+	now += 60 * S;
+	CHECK_EQ(recovery_failed(&recovery, now, 0), RECOVERY_MIN_US);
+	CHECK_EQ(recovery.failures, 1);
+}
+
+/*
+ * A capture source that fails on cue: attempt n fails if bit n of faults
+ * is set. Waits advance a simulated clock and are recorded.
+ */
+struct faulty_source {
+	int64_t now;
+	unsigned int faults;
+	int attempts;
+	int64_t waits[16];
+	int waited;
+};
+
+static int faulty_attempt(void *data)
+{
+	struct faulty_source *source = data;
+
+	return (source->faults >> source->attempts++) & 1 ? -1 : 0;
+}
+
+static void faulty_wait(void *data, int64_t us)
+{
+	struct faulty_source *source = data;
+
+	if (source->waited < 16)
+		source->waits[source->waited] = us;
+	source->waited++;
+	source->now += us;
+}
+
+static int64_t faulty_now(void *data)
+{
+	struct faulty_source *source = data;
+
+	return source->now;
+}
+
+/* loses the capture and runs the restart loop of the supervisor until it captures again */
+static int restart(struct recovery *recovery, struct faulty_source *faulty, unsigned int faults)
+{
+	struct recovery_source source = { faulty, faulty_attempt, faulty_wait, faulty_now };
+	int failed;
+
+	faulty->faults = faults;
+	faulty->attempts = 0;
+	faulty->waited = 0;
+	failed = recovery_retry(recovery, recovery_failed(recovery, faulty->now, 1), &source);
+	recovery_succeeded(recovery, faulty->now);
+
+	return failed;
+}
+
+static void test_retry(void)
+{
+	struct recovery recovery;
+	struct faulty_source source;
+
+	memset(&source, 0, sizeof(source));
+	source.now = 100 * S;
+	recovery_init(&recovery);
+	recovery_succeeded(&recovery, source.now);
+
+	/* lost right away, three attempts fail, the waits double */
+	source.now += S / 2;
+	CHECK_EQ(restart(&recovery, &source, 0x7), 3);
+	CHECK_EQ(source.attempts, 4);
+	CHECK_EQ(source.waited, 4);
+	CHECK_EQ(source.waits[0], RECOVERY_MIN_US);
+	CHECK_EQ(source.waits[1], 2 * RECOVERY_MIN_US);
+	CHECK_EQ(source.waits[2], 4 * RECOVERY_MIN_US);
+	CHECK_EQ(source.waits[3], 8 * RECOVERY_MIN_US);
+
+	/* lost again before it was stable, the backoff continues */
+	source.now += S / 2;
+	CHECK_EQ(restart(&recovery, &source, 0x0), 0);
+	CHECK_EQ(source.waited, 1);
+	CHECK_EQ(source.waits[0], 16 * RECOVERY_MIN_US);
+
+	/* a stable run, the loss is retried at once and earlier failures are forgotten */
+	source.now += RECOVERY_STABLE_US;
+	CHECK_EQ(restart(&recovery, &source, 0x3), 2);
+	CHECK_EQ(source.attempts, 3);
+	CHECK_EQ(source.waited, 2);
+	CHECK_EQ(source.waits[0], RECOVERY_MIN_US);
+	CHECK_EQ(source.waits[1], 2 * RECOVERY_MIN_US);
+
+	/* and once more, a stable loss that recovers on the first attempt never waits */
+	source.now += 60 * S;
+	CHECK_EQ(restart(&recovery, &source, 0x0), 0);
+	CHECK_EQ(source.waited, 0);
+
+	/* a long outage is capped */
+	source.now += 60 * S;
+	CHECK_EQ(restart(&recovery, &source, 0xfff), 12);
+	CHECK_EQ(source.waited, 12);
+	CHECK_EQ(source.waits[6], 64 * RECOVERY_MIN_US);
+	CHECK_EQ(source.waits[7], RECOVERY_MAX_US);
+	CHECK_EQ(source.waits[11], RECOVERY_MAX_US);
+}
+
+int main(void)
+{
+	test_backoff();
+	test_stable();
+	test_stable_init_failure();
+	test_retry();
+
+	return test_result();
+}
@@ -0,0 +1,90 @@
+#include "refine.h"
+#include "test.h"
+
+static void test_mark_clear(void)
+{
+	struct refine_map map;
+	struct rect r = { 10, 10, 100, 70 };
+	struct rect whole = { 0, 0, 128, 128 };
+
+	CHECK_EQ(refine_init(&map, 300, 200), 0);
+	CHECK_EQ(map.cols, 5);
+	CHECK_EQ(map.rows, 4);
+
+	/* every tile touched is marked */
+	refine_mark(&map, &r);
+	CHECK_EQ(refine_pending(&map), 4);
+
+	/* only tiles covered completely are clean again */
+	refine_clear(&map, &r);
+	CHECK_EQ(refine_pending(&map), 4);
+	refine_clear(&map, &whole);
+	CHECK_EQ(refine_pending(&map), 0);
+
+	refine_cleanup(&map);
+}
+
+static void test_order(void)
+{
+	struct refine_map map;
+	struct rect all = { 0, 0, 300, 200 };
+	struct rect tile;
+
+	CHECK_EQ(refine_init(&map, 300, 200), 0);
+	refine_mark(&map, &all);
+
+	/* closest to the pointer first */
+	CHECK(refine_next(&map, &all, 200, 100, &tile));
+	CHECK_EQ(tile.left, 192);
+	CHECK_EQ(tile.top, 64);
+	CHECK(refine_next(&map, &all, 200, 100, &tile));
+	CHECK(tile.left != 192 || tile.top != 64);
+
+	/* edge tiles end at the surface */
+	CHECK(refine_next(&map, &all, 299, 199, &tile));
+	CHECK_EQ(tile.right, 300);
+	CHECK_EQ(tile.bottom, 200);
+
+	refine_cleanup(&map);
+}
+
+static void test_area(void)
+{
+	struct refine_map map;
+	/* two outputs side by side, the boundary inside a tile */
+	struct rect left = { 0, 0, 100, 200 };
+	struct rect right = { 100, 0, 300, 200 };
+	struct rect all = { 0, 0, 300, 200 };
+	struct rect tile;
+	int count = 0;
+
+	CHECK_EQ(refine_init(&map, 300, 200), 0);
+	refine_mark(&map, &all);
+
+	/* the pointer is on the right output, the left one stays on its own */
+	while (refine_next(&map, &left, 250, 100, &tile)) {
+		CHECK(tile.left < left.right);
+		count++;
+	}
+	CHECK_EQ(count, 8);
+	CHECK_EQ(refine_pending(&map), 12);
+
+	count = 0;
+	while (refine_next(&map, &right, 250, 100, &tile)) {
+		CHECK(tile.right > right.left);
+		count++;
+	}
+	CHECK_EQ(count, 12);
+	CHECK_EQ(refine_pending(&map), 0);
+
+	refine_cleanup(&map);
+}
+
+int main(void)
+{
+	test_mark_clear();
+	test_order();
+	test_area();
+
+	return test_result();
+}
@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "rotate.h"
+#include "test.h"
+
+static uint32_t pixel(int x, int y)
+{
+	return (uint32_t) y << 16 | (uint32_t) x;
+}
+
+/* texture size for a desktop of width x height */
+static void texture_size(enum rotation rotation, int width, int height, int *tex_width, int *tex_height)
+{
+	int swap = rotation == ROTATION_90 || rotation == ROTATION_270;
+
+	*tex_width = swap ? height : width;
+	*tex_height = swap ? width : height;
+}
+
+/* single pixels land where the rect transform puts them and map back */
+static void test_rect_round_trip(enum rotation rotation, int width, int height)
+{
+	int tex_width, tex_height, x, y;
+
+	texture_size(rotation, width, height, &tex_width, &tex_height);
+	for (y = 0; y < tex_height; ++y) {
+		for (x = 0; x < tex_width; ++x) {
+			struct rect tex = { x, y, x + 1, y + 1 };
+			struct rect desk, back;
+
+			rotation_rect_to_desktop(rotation, width, height, &tex, &desk);
+			CHECK_EQ(rect_width(&desk), 1);
+			CHECK_EQ(rect_height(&desk), 1);
+			CHECK(desk.left >= 0 && desk.top >= 0 && desk.right <= width && desk.bottom <= height);
+
+			rotation_rect_to_texture(rotation, width, height, &desk, &back);
+			CHECK(memcmp(&back, &tex, sizeof(tex)) == 0);
+		}
+	}
+}
+
+static void test_known_corners(void)
+{
+	/* 4x2 desktop, the top left texture pixel of a 90 degree rotation is the top right one */
+	struct rect tex = { 0, 0, 1, 1 };
+	struct rect desk;
+
+	rotation_rect_to_desktop(ROTATION_90, 4, 2, &tex, &desk);
+	CHECK_EQ(desk.left, 3);
+	CHECK_EQ(desk.top, 0);
+
+	rotation_rect_to_desktop(ROTATION_180, 4, 2, &tex, &desk);
+	CHECK_EQ(desk.left, 3);
+	CHECK_EQ(desk.top, 1);
+
+	rotation_rect_to_desktop(ROTATION_270, 4, 2, &tex, &desk);
+	CHECK_EQ(desk.left, 0);
+	CHECK_EQ(desk.top, 1);
+}
+
+/*
+ * Rotates a sub rect of the texture and compares every pixel with the
+ * position the rect transform gives for it. The sizes cover the 4 pixel
+ * SIMD blocks, their tails and the cache tiles.
+ */
+static void test_copy(enum rotation rotation, int width, int height, const struct rect *area)
+{
+	int tex_width, tex_height, x, y;
+	struct rect tex;
+	uint32_t *texture, *out;
+	int out_width = rect_width(area);
+	int out_height = rect_height(area);
+
+	texture_size(rotation, width, height, &tex_width, &tex_height);
+	texture = malloc((size_t) tex_width * tex_height * 4);
+	/* a guard column catches writes past the destination width */
+	out = malloc((size_t) (out_width + 1) * out_height * 4);
+	for (y = 0; y < tex_height; ++y)
+		for (x = 0; x < tex_width; ++x)
+			texture[y * tex_width + x] = pixel(x, y);
+	memset(out, 0xff, (size_t) (out_width + 1) * out_height * 4);
+
+	rotation_rect_to_texture(rotation, width, height, area, &tex);
+	rotation_copy(rotation, (const uint8_t *) (texture + tex.top * tex_width + tex.left), tex_width * 4,
+				  rect_width(&tex), rect_height(&tex), (uint8_t *) out, (out_width + 1) * 4);
+
+	for (y = 0; y < out_height; ++y) {
+		for (x = 0; x < out_width; ++x) {
+			struct rect desk = { area->left + x, area->top + y, area->left + x + 1, area->top + y + 1 };
+			struct rect src;
+
+			rotation_rect_to_texture(rotation, width, height, &desk, &src);
+			if (out[y * (out_width + 1) + x] != pixel(src.left, src.top)) {
+				fprintf(stderr, "rotation %d %dx%d: pixel %d,%d\n", rotation, width, height, x, y);
+				test_failures++;
+				goto done;
+			}
+		}
+		CHECK_EQ(out[y * (out_width + 1) + out_width], 0xffffffff);
+	}
+
+done:
+	free(texture);
+	free(out);
+}
+
+int main(void)
+{
+	static const int sizes[][2] = {
+		{ 1, 1 }, { 3, 5 }, { 4, 4 }, { 7, 9 }, { 17, 13 }, { 64, 64 }, { 131, 67 }, { 203, 130 },
+	};
+	enum rotation rotation;
+	size_t i;
+
+	test_known_corners();
+
+	for (rotation = ROTATION_0; rotation <= ROTATION_270; ++rotation) {
+		for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+			int width = sizes[i][0], height = sizes[i][1];
+			struct rect full = { 0, 0, width, height };
+			/* an inner area with odd offsets and sizes */
+			struct rect inner = { width / 3, height / 5, width - width / 4, height - height / 7 };
+
+			test_rect_round_trip(rotation, width, height);
+			test_copy(rotation, width, height, &full);
+			if (!rect_is_empty(&inner))
+				test_copy(rotation, width, height, &inner);
+		}
+	}
+
+	return test_result();
+}
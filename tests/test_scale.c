@@ -0,0 +1,160 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scale.h"
+#include "test.h"
+
+#define SRC_WIDTH 53
+#define SRC_HEIGHT 37
+
+static uint32_t src[SRC_HEIGHT][SRC_WIDTH];
+
+static void fill_source(void)
+{
+	uint32_t seed = 12345;
+	int x, y;
+
+	for (y = 0; y < SRC_HEIGHT; ++y) {
+		for (x = 0; x < SRC_WIDTH; ++x) {
+			seed = seed * 1103515245 + 12345;
+			src[y][x] = seed ^ (seed >> 16);
+		}
+	}
+}
+
+static int channel(uint32_t pixel, int c)
+{
+	return (pixel >> (8 * c)) & 0xff;
+}
+
+/*
+ * The box filter spelled out from the public tables, vertical pass first,
+ * each pass rounding to 8 bits. Both the SSE2 and the scalar build have to
+ * produce exactly this.
+ */
+static uint32_t reference_box(const struct scaler *scaler, int dx, int dy)
+{
+	const struct scale_axis *x = &scaler->x, *y = &scaler->y;
+	uint32_t pixel = 0;
+	int c, i, j;
+
+	for (c = 0; c < 4; ++c) {
+		unsigned int sum = 128;
+
+		for (i = 0; i < x->last[dx] - x->first[dx]; ++i) {
+			unsigned int column = 128;
+
+			for (j = 0; j < y->last[dy] - y->first[dy]; ++j)
+				column += channel(src[y->first[dy] + j][x->first[dx] + i], c) * y->weight[dy * y->taps + j];
+			sum += (column >> 8) * x->weight[dx * x->taps + i];
+		}
+		pixel |= (sum >> 8) << (8 * c);
+	}
+
+	return pixel;
+}
+
+/* plain area average in floating point */
+static double area_average(int src_width, int src_height, int dst_width, int dst_height, int dx, int dy, int c)
+{
+	double x0 = (double) dx * src_width / dst_width, x1 = (double) (dx + 1) * src_width / dst_width;
+	double y0 = (double) dy * src_height / dst_height, y1 = (double) (dy + 1) * src_height / dst_height;
+	double sum = 0;
+	int x, y;
+
+	for (y = (int) y0; y < y1; ++y) {
+		double h = fmin(y + 1, y1) - fmax(y, y0);
+
+		for (x = (int) x0; x < x1; ++x)
+			sum += channel(src[y][x], c) * h * (fmin(x + 1, x1) - fmax(x, x0));
+	}
+
+	return sum / ((x1 - x0) * (y1 - y0));
+}
+
+static void test_weights(void)
+{
+	struct scaler scaler;
+	int i, k;
+
+	/* 3 -> 2, every destination pixel covers one and a half source pixels */
+	CHECK_EQ(scaler_init(&scaler, 3, 3, 2, 2, SCALE_FILTER_BOX), 0);
+	CHECK_EQ(scaler.x.taps, 2);
+	CHECK_EQ(scaler.x.weight[0], 171);
+	CHECK_EQ(scaler.x.weight[1], 85);
+	CHECK_EQ(scaler.x.weight[2], 85);
+	CHECK_EQ(scaler.x.weight[3], 171);
+	scaler_cleanup(&scaler);
+
+	/* the weights of every destination pixel sum up to 256 */
+	CHECK_EQ(scaler_init(&scaler, SRC_WIDTH, SRC_HEIGHT, 17, 29, SCALE_FILTER_BOX), 0);
+	for (i = 0; i < 17; ++i) {
+		int sum = 0;
+
+		for (k = 0; k < scaler.x.taps; ++k)
+			sum += scaler.x.weight[i * scaler.x.taps + k];
+		CHECK_EQ(sum, 256);
+	}
+	scaler_cleanup(&scaler);
+}
+
+static void test_box(int dst_width, int dst_height)
+{
+	struct scaler scaler;
+	struct rect dirty = { 5, 3, 31, 20 };
+	struct rect dst_rect, src_rect;
+	uint32_t *dst;
+	int x, y, c, worst = 0;
+
+	CHECK_EQ(scaler_init(&scaler, SRC_WIDTH, SRC_HEIGHT, dst_width, dst_height, SCALE_FILTER_BOX), 0);
+	dst = calloc((size_t) dst_width * dst_height, sizeof(*dst));
+
+	/* the whole frame */
+	dst_rect = (struct rect) { 0, 0, dst_width, dst_height };
+	src_rect = (struct rect) { 0, 0, SRC_WIDTH, SRC_HEIGHT };
+	scaler_scale(&scaler, &dst_rect, (uint8_t *) dst, dst_width * 4,
+				 &src_rect, (const uint8_t *) src, sizeof(src[0]));
+
+	for (y = 0; y < dst_height; ++y) {
+		for (x = 0; x < dst_width; ++x) {
+			CHECK_EQ(dst[y * dst_width + x], reference_box(&scaler, x, y));
+			for (c = 0; c < 4; ++c) {
+				double error = fabs(channel(dst[y * dst_width + x], c) -
+									area_average(SRC_WIDTH, SRC_HEIGHT, dst_width, dst_height, x, y, c));
+				if (error > worst)
+					worst = (int) ceil(error);
+			}
+		}
+	}
+	/* quantized weights and two roundings stay within a couple of steps */
+	CHECK(worst <= 2);
+
+	/* a dirty rect, src only holds the footprint scaler_map_rect asks for */
+	memset(dst, 0, (size_t) dst_width * dst_height * sizeof(*dst));
+	scaler_map_rect(&scaler, &dirty, &dst_rect, &src_rect);
+	scaler_scale(&scaler, &dst_rect, (uint8_t *) dst, dst_width * 4, &src_rect,
+				 (const uint8_t *) &src[src_rect.top][src_rect.left], sizeof(src[0]));
+	for (y = dst_rect.top; y < dst_rect.bottom; ++y)
+		for (x = dst_rect.left; x < dst_rect.right; ++x)
+			CHECK_EQ(dst[(y - dst_rect.top) * dst_width + x - dst_rect.left], reference_box(&scaler, x, y));
+
+	free(dst);
+	scaler_cleanup(&scaler);
+}
+
+int main(void)
+{
+	fill_source();
+
+	test_weights();
+	/* integer and fractional ratios, odd widths leave a scalar tail */
+	test_box(17, 29);
+	test_box(26, 18);
+	test_box(40, 30);
+	test_box(11, 7);
+	test_box(80, 50);
+
+	return test_result();
+}
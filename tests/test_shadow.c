@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "shadow.h"
+#include "test.h"
+
+static uint32_t pattern(int x, int y)
+{
+	return 0xff000000u | (uint32_t) y << 12 | (uint32_t) x;
+}
+
+static uint32_t shadow_pixel(const struct shadow *shadow, int x, int y)
+{
+	return *(const uint32_t *) (shadow->pixels + y * shadow->stride + x * 4);
+}
+
+/* a new framebuffer is black, written pixels read back unchanged */
+static void test_write_read(void)
+{
+	struct shadow shadow;
+	struct rect rect = { 3, 2, 9, 7 };
+	uint32_t in[5][6], out[5][8];
+	int x, y;
+
+	CHECK_EQ(shadow_init(&shadow, 16, 10), 0);
+	CHECK_EQ(shadow.stride, 16 * 4);
+	for (y = 0; y < 10; ++y)
+		for (x = 0; x < 16; ++x)
+			CHECK_EQ(shadow_pixel(&shadow, x, y), 0);
+
+	for (y = 0; y < 5; ++y)
+		for (x = 0; x < 6; ++x)
+			in[y][x] = pattern(rect.left + x, rect.top + y);
+	shadow_write(&shadow, &rect, (const uint8_t *) in, sizeof(in[0]));
+
+	for (y = 0; y < 10; ++y)
+		for (x = 0; x < 16; ++x)
+			CHECK_EQ(shadow_pixel(&shadow, x, y),
+					 x >= rect.left && x < rect.right && y >= rect.top && y < rect.bottom ? pattern(x, y) : 0);
+
+	/* a wider destination stride leaves the padding alone */
+	memset(out, 0xaa, sizeof(out));
+	shadow_read(&shadow, &rect, (uint8_t *) out, sizeof(out[0]));
+	for (y = 0; y < 5; ++y) {
+		for (x = 0; x < 6; ++x)
+			CHECK_EQ(out[y][x], in[y][x]);
+		CHECK_EQ(out[y][6], 0xaaaaaaaau);
+		CHECK_EQ(out[y][7], 0xaaaaaaaau);
+	}
+
+	shadow_cleanup(&shadow);
+}
+
+static void test_differs(void)
+{
+	struct shadow shadow;
+	struct rect rect = { 0, 0, 4, 4 };
+	struct rect outside = { 20, 20, 24, 24 };
+	uint32_t in[4][4];
+	int x, y;
+
+	CHECK_EQ(shadow_init(&shadow, 8, 8), 0);
+	for (y = 0; y < 4; ++y)
+		for (x = 0; x < 4; ++x)
+			in[y][x] = pattern(x, y);
+
+	CHECK(shadow_differs(&shadow, &rect, (const uint8_t *) in, sizeof(in[0])));
+	shadow_write(&shadow, &rect, (const uint8_t *) in, sizeof(in[0]));
+	CHECK(!shadow_differs(&shadow, &rect, (const uint8_t *) in, sizeof(in[0])));
+
+	/* a single pixel in the last row is enough */
+	in[3][3] ^= 1;
+	CHECK(shadow_differs(&shadow, &rect, (const uint8_t *) in, sizeof(in[0])));
+
+	/* nothing of it is on the framebuffer */
+	CHECK(!shadow_differs(&shadow, &outside, (const uint8_t *) in, sizeof(in[0])));
+
+	shadow_cleanup(&shadow);
+}
+
+/* rects reaching past the framebuffer only touch the part inside */
+static void test_clipping(void)
+{
+	struct shadow shadow;
+	struct rect rect = { -2, -1, 3, 2 };
+	struct rect outside = { 8, 0, 10, 2 };
+	uint32_t in[3][5], out[3][5];
+	int x, y;
+
+	CHECK_EQ(shadow_init(&shadow, 8, 4), 0);
+	for (y = 0; y < 3; ++y)
+		for (x = 0; x < 5; ++x)
+			in[y][x] = pattern(x, y);
+
+	shadow_write(&shadow, &rect, (const uint8_t *) in, sizeof(in[0]));
+	for (y = 0; y < 4; ++y)
+		for (x = 0; x < 8; ++x)
+			CHECK_EQ(shadow_pixel(&shadow, x, y), x < 3 && y < 2 ? in[y + 1][x + 2] : 0);
+
+	/* pixels of the rect outside the framebuffer are not written on read */
+	memset(out, 0x55, sizeof(out));
+	shadow_read(&shadow, &rect, (uint8_t *) out, sizeof(out[0]));
+	for (y = 0; y < 3; ++y)
+		for (x = 0; x < 5; ++x)
+			CHECK_EQ(out[y][x], x >= 2 && y >= 1 ? in[y][x] : 0x55555555u);
+
+	shadow_write(&shadow, &outside, (const uint8_t *) in, sizeof(in[0]));
+	for (y = 0; y < 4; ++y)
+		CHECK_EQ(shadow_pixel(&shadow, 7, y), 0);
+
+	shadow_cleanup(&shadow);
+}
+
+static void check_black(const struct shadow *shadow)
+{
+	int x, y;
+
+	for (y = 0; y < shadow->height; ++y)
+		for (x = 0; x < shadow->width; ++x)
+			CHECK_EQ(shadow_pixel(shadow, x, y), 0);
+}
+
+/*
+ * A layout change replaces the framebuffer by a black one of the new
+ * size, the next full frame fills it. Writes and reads clip to the new
+ * size and use its stride.
+ */
+static void test_resize(void)
+{
+	struct shadow shadow;
+	struct rect full = { 0, 0, 12, 6 };
+	uint32_t in[6][12], out[6][12];
+	int x, y;
+
+	for (y = 0; y < 6; ++y)
+		for (x = 0; x < 12; ++x)
+			in[y][x] = pattern(x, y);
+
+	CHECK_EQ(shadow_init(&shadow, 8, 4), 0);
+	shadow_write(&shadow, &full, (const uint8_t *) in, sizeof(in[0]));
+
+	/* grow */
+	CHECK_EQ(shadow_resize(&shadow, 12, 6), 0);
+	CHECK_EQ(shadow.width, 12);
+	CHECK_EQ(shadow.height, 6);
+	CHECK_EQ(shadow.stride, 12 * 4);
+	check_black(&shadow);
+
+	shadow_write(&shadow, &full, (const uint8_t *) in, sizeof(in[0]));
+	memset(out, 0, sizeof(out));
+	shadow_read(&shadow, &full, (uint8_t *) out, sizeof(out[0]));
+	CHECK(memcmp(out, in, sizeof(in)) == 0);
+
+	/* shrink, the old contents do not survive in the smaller buffer either */
+	CHECK_EQ(shadow_resize(&shadow, 5, 3), 0);
+	CHECK_EQ(shadow.stride, 5 * 4);
+	check_black(&shadow);
+	CHECK(shadow_differs(&shadow, &full, (const uint8_t *) in, sizeof(in[0])));
+
+	/* a frame of the old size is clipped to the new one */
+	shadow_write(&shadow, &full, (const uint8_t *) in, sizeof(in[0]));
+	for (y = 0; y < 3; ++y)
+		for (x = 0; x < 5; ++x)
+			CHECK_EQ(shadow_pixel(&shadow, x, y), pattern(x, y));
+	CHECK(!shadow_differs(&shadow, &full, (const uint8_t *) in, sizeof(in[0])));
+
+	memset(out, 0, sizeof(out));
+	shadow_read(&shadow, &full, (uint8_t *) out, sizeof(out[0]));
+	for (y = 0; y < 6; ++y)
+		for (x = 0; x < 12; ++x)
+			CHECK_EQ(out[y][x], x < 5 && y < 3 ? in[y][x] : 0);
+
+	shadow_cleanup(&shadow);
+}
+
+int main(void)
+{
+	test_write_read();
+	test_differs();
+	test_clipping();
+	test_resize();
+
+	return test_result();
+}
@@ -0,0 +1,205 @@
+#include "video.h"
+#include "test.h"
+
+#define FRAME_US 33333
+
+static const struct rect video_area = { 200, 100, 840, 460 };
+
+/* the video with its dirty rect off by up to 7 pixels per side */
+static struct rect jittered(int frame)
+{
+	int d = (frame * 5) % 8;
+
+	return (struct rect) { video_area.left + d, video_area.top + 7 - d,
+						   video_area.right - (7 - d), video_area.bottom - d };
+}
+
+static int same_rect(const struct rect *a, const struct rect *b)
+{
+	return a->left == b->left && a->top == b->top && a->right == b->right && a->bottom == b->bottom;
+}
+
+static void test_converge(void)
+{
+	struct video_tracker tracker;
+	struct rect video[VIDEO_MAX_AREAS], stable = { 0 };
+	int frame, found = 0, changed = 0;
+
+	video_tracker_init(&tracker);
+	for (frame = 0; frame < 40; ++frame) {
+		struct region damage;
+		struct rect r = jittered(frame);
+		int n;
+
+		region_init(&damage);
+		region_add(&damage, &r);
+		n = video_tracker_update(&tracker, &damage, frame * FRAME_US, video);
+
+		/* the first frames go out as they are */
+		if (frame < 7) {
+			CHECK_EQ(n, 0);
+			CHECK_EQ(damage.count, 1);
+			continue;
+		}
+
+		CHECK_EQ(n, 1);
+		CHECK_EQ(damage.count, 0);
+		if (found && !same_rect(&stable, &video[0]))
+			changed++;
+		stable = video[0];
+		found = 1;
+	}
+
+	/* the box stops moving once it covers all the jitter */
+	CHECK_EQ(changed, 0);
+	CHECK(stable.left <= video_area.left + 7 && stable.right >= video_area.right - 7);
+	CHECK(stable.left >= video_area.left && stable.right <= video_area.right);
+}
+
+static void test_split(void)
+{
+	struct video_tracker tracker;
+	struct rect video[VIDEO_MAX_AREAS];
+	int frame, n = 0;
+
+	/* every other frame arrives in two parts, one of them small */
+	video_tracker_init(&tracker);
+	for (frame = 0; frame < 20; ++frame) {
+		struct region damage;
+		struct rect upper = video_area, lower = video_area;
+
+		region_init(&damage);
+		if (frame % 2) {
+			upper.bottom = video_area.bottom - 40;
+			lower.top = upper.bottom + 8;
+		}
+		region_add(&damage, &upper);
+		if (frame % 2)
+			region_add(&damage, &lower);
+		n = video_tracker_update(&tracker, &damage, frame * FRAME_US, video);
+	}
+
+	CHECK_EQ(n, 1);
+	CHECK(same_rect(&video[0], &video_area));
+	CHECK_EQ(tracker.areas[0].hits, 20);
+}
+
+static void warm_up(struct video_tracker *tracker, int64_t *now)
+{
+	struct rect video[VIDEO_MAX_AREAS];
+	int frame;
+
+	video_tracker_init(tracker);
+	for (frame = 0; frame < 10; ++frame, *now += FRAME_US) {
+		struct region damage;
+
+		region_init(&damage);
+		region_add(&damage, &video_area);
+		video_tracker_update(tracker, &damage, *now, video);
+	}
+}
+
+static void test_growth(void)
+{
+	struct video_tracker tracker;
+	struct rect video[VIDEO_MAX_AREAS];
+	struct region damage;
+	int64_t now = 0;
+	int frame, n;
+
+	warm_up(&tracker, &now);
+
+	/* a window dragged across the area, the box would sweep the screen */
+	for (frame = 0; frame < 30; ++frame, now += FRAME_US) {
+		struct rect r = video_area;
+
+		rect_translate(&r, 100 * (frame + 1), 0);
+		region_init(&damage);
+		region_add(&damage, &r);
+		n = video_tracker_update(&tracker, &damage, now, video);
+		if (n)
+			CHECK(rect_area(&video[0]) <= 4 * rect_area(&video_area));
+	}
+
+	/* it started over more than once and never grew out of bounds */
+	CHECK(rect_area(&tracker.areas[0].rect) <= 4 * rect_area(&video_area));
+	CHECK(tracker.areas[0].hits < 30);
+}
+
+static void test_timeout(void)
+{
+	struct video_tracker tracker;
+	struct rect video[VIDEO_MAX_AREAS];
+	struct region damage;
+	int64_t now = 0;
+
+	warm_up(&tracker, &now);
+	CHECK_EQ(tracker.count, 1);
+
+	/* a pause shorter than the timeout keeps the area */
+	now += 400 * 1000;
+	region_init(&damage);
+	region_add(&damage, &video_area);
+	CHECK_EQ(video_tracker_update(&tracker, &damage, now, video), 1);
+
+	/* after a long pause the video has to prove itself again */
+	now += 600 * 1000;
+	region_init(&damage);
+	region_add(&damage, &video_area);
+	CHECK_EQ(video_tracker_update(&tracker, &damage, now, video), 0);
+	CHECK_EQ(tracker.count, 1);
+	CHECK_EQ(tracker.areas[0].hits, 1);
+	CHECK_EQ(damage.count, 1);
+}
+
+static int64_t region_area(const struct region *region)
+{
+	int64_t area = 0;
+	int i;
+
+	for (i = 0; i < region->count; ++i)
+		area += rect_area(&region->rects[i]);
+
+	return area;
+}
+
+static void test_remainder(void)
+{
+	struct video_tracker tracker;
+	struct rect video[VIDEO_MAX_AREAS];
+	struct region damage;
+	/* this frame changed less, a tooltip lies over the edge of the box */
+	struct rect frame = { video_area.left, video_area.top, video_area.right - 10, video_area.bottom };
+	struct rect tooltip = { video_area.right - 8, video_area.top + 50, video_area.right + 60, video_area.top + 80 };
+	struct rect outside = { video_area.right, tooltip.top, tooltip.right, tooltip.bottom };
+	struct rect clock = { 1800, 1040, 1900, 1070 };
+	struct rect overlap;
+	int64_t now = 0;
+	int i;
+
+	warm_up(&tracker, &now);
+
+	region_init(&damage);
+	region_add(&damage, &frame);
+	region_add(&damage, &tooltip);
+	region_add(&damage, &clock);
+	CHECK_EQ(damage.count, 3);
+	CHECK_EQ(video_tracker_update(&tracker, &damage, now, video), 1);
+	CHECK(same_rect(&video[0], &video_area));
+
+	/* what lies outside the video is still damage, nothing inside */
+	CHECK_EQ(region_area(&damage), rect_area(&clock) + rect_area(&outside));
+	for (i = 0; i < damage.count; ++i)
+		CHECK(!rect_intersect(&overlap, &damage.rects[i], &video[0]));
+}
+
+int main(void)
+{
+	test_converge();
+	test_split();
+	test_growth();
+	test_timeout();
+	test_remainder();
+
+	return test_result();
+}
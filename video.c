@@ -0,0 +1,145 @@
+#include "video.h"
+
+/* spice does not stream anything smaller, RED_STREAM_MIN_SIZE */
+#define VIDEO_MIN_AREA (96 * 96)
+#define VIDEO_MIN_FRAMES 8
+#define VIDEO_MIN_FPS 8
+/* an area without damage for this long is forgotten */
+#define VIDEO_TIMEOUT_US (500 * 1000)
+/* the union may not outgrow the damage by more, it is something else then */
+#define VIDEO_MAX_GROWTH 4
+
+void video_tracker_init(struct video_tracker *tracker)
+{
+	tracker->count = 0;
+}
+
+static void video_remove(struct video_tracker *tracker, int index)
+{
+	tracker->areas[index] = tracker->areas[--tracker->count];
+}
+
+static int video_is_active(const struct video_area *area, int64_t now)
+{
+	int64_t elapsed = now - area->first;
+
+	return area->hits >= VIDEO_MIN_FRAMES &&
+		(elapsed <= 0 || area->hits * 1000000 / elapsed >= VIDEO_MIN_FPS);
+}
+
+static void video_hit(struct video_tracker *tracker, const struct rect *r, int64_t now)
+{
+	struct rect overlap;
+	int i;
+
+	for (i = 0; i < tracker->count; ++i) {
+		struct video_area *area = &tracker->areas[i];
+		int64_t smaller = rect_area(r) < rect_area(&area->rect) ? rect_area(r) : rect_area(&area->rect);
+
+		if (!rect_intersect(&overlap, &area->rect, r) || 2 * rect_area(&overlap) < smaller)
+			continue;
+
+		/* one hit per send, a video frame can be split in several rects */
+		if (area->last != now) {
+			area->hits++;
+			area->damage = *r;
+			area->damage_area = 0;
+		}
+		area->last = now;
+
+		rect_union(&area->rect, &area->rect, r);
+		rect_union(&area->damage, &area->damage, r);
+		area->damage_area += rect_area(r);
+		return;
+	}
+
+	if (tracker->count < VIDEO_MAX_AREAS) {
+		struct video_area *area = &tracker->areas[tracker->count++];
+
+		area->rect = *r;
+		area->damage = *r;
+		area->damage_area = rect_area(r);
+		area->first = now;
+		area->last = now;
+		area->hits = 1;
+	}
+}
+
+/* checked once all parts of a send are in, a part alone may be small */
+static void video_check_growth(struct video_area *area, int64_t now)
+{
+	if (rect_area(&area->rect) > VIDEO_MAX_GROWTH * area->damage_area) {
+		area->rect = area->damage;
+		area->first = now;
+		area->hits = 1;
+	}
+}
+
+/* splits a minus b in up to four rects */
+static int rect_subtract(const struct rect *a, const struct rect *b, struct rect *out)
+{
+	struct rect overlap;
+	int n = 0;
+
+	if (!rect_intersect(&overlap, a, b)) {
+		out[n++] = *a;
+		return n;
+	}
+
+	if (a->top < overlap.top)
+		out[n++] = (struct rect) { a->left, a->top, a->right, overlap.top };
+	if (overlap.bottom < a->bottom)
+		out[n++] = (struct rect) { a->left, overlap.bottom, a->right, a->bottom };
+	if (a->left < overlap.left)
+		out[n++] = (struct rect) { a->left, overlap.top, overlap.left, overlap.bottom };
+	if (overlap.right < a->right)
+		out[n++] = (struct rect) { overlap.right, overlap.top, a->right, overlap.bottom };
+
+	return n;
+}
+
+int video_tracker_update(struct video_tracker *tracker, struct region *damage, int64_t now,
+						 struct rect *video)
+{
+	int n = 0;
+	int i, j;
+
+	for (i = 0; i < tracker->count; ) {
+		if (now - tracker->areas[i].last > VIDEO_TIMEOUT_US)
+			video_remove(tracker, i);
+		else
+			++i;
+	}
+
+	for (i = 0; i < damage->count; ++i)
+		if (rect_area(&damage->rects[i]) >= VIDEO_MIN_AREA)
+			video_hit(tracker, &damage->rects[i], now);
+
+	for (i = 0; i < tracker->count; ++i) {
+		if (tracker->areas[i].last != now)
+			continue;
+		video_check_growth(&tracker->areas[i], now);
+		if (video_is_active(&tracker->areas[i], now))
+			video[n++] = tracker->areas[i].rect;
+	}
+
+	if (!n)
+		return 0;
+
+	/* whatever damage lies outside the video areas is sent as usual */
+	for (j = 0; j < n; ++j) {
+		struct region rest;
+
+		region_init(&rest);
+		for (i = 0; i < damage->count; ++i) {
+			struct rect parts[4];
+			int k, count = rect_subtract(&damage->rects[i], &video[j], parts);
+
+			for (k = 0; k < count; ++k)
+				region_add(&rest, &parts[k]);
+		}
+		*damage = rest;
+	}
+
+	return n;
+}
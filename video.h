@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "region.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define VIDEO_MAX_AREAS 4
+
+/*
+ * Finds areas that change at a video like rate. The dirty rects of a
+ * playing video jitter from frame to frame, spice only detects a stream
+ * if every frame arrives as a drawable with the same bounding box. A
+ * tracked area grows to the union of its damage and is sent whole.
+ */
+struct video_area {
+	struct rect rect;
+	struct rect damage;		/* bounding box of the last hit */
+	int64_t damage_area;	/* pixels of the last hit */
+	int64_t first;	/* us */
+	int64_t last;
+	int hits;
+};
+
+struct video_tracker {
+	struct video_area areas[VIDEO_MAX_AREAS];
+	int count;
+};
+
+void video_tracker_init(struct video_tracker *tracker);
+
+/*
+ * Feeds the damage of one send. Video areas hit by it are removed from
+ * damage and returned in video, at most VIDEO_MAX_AREAS.
+ */
+int video_tracker_update(struct video_tracker *tracker, struct region *damage, int64_t now,
+						 struct rect *video);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif